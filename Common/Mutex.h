@@ -0,0 +1,107 @@
+#ifndef _MUTEX_H
+#define _MUTEX_H
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+
+namespace tensir
+{
+    /**
+     * @brief 局部锁，构造时加锁，析构时解锁
+     */
+    template <class T>
+    class ScopedLockImpl
+    {
+    public:
+        ScopedLockImpl(T &mutex)
+            : m_mutex(mutex)
+        {
+            m_mutex.lock();
+            m_locked = true;
+        }
+
+        ~ScopedLockImpl()
+        {
+            unlock();
+        }
+
+        void lock()
+        {
+            if (!m_locked)
+            {
+                m_mutex.lock();
+                m_locked = true;
+            }
+        }
+
+        void unlock()
+        {
+            if (m_locked)
+            {
+                m_mutex.unlock();
+                m_locked = false;
+            }
+        }
+
+    private:
+        ScopedLockImpl(const ScopedLockImpl &) = delete;
+        ScopedLockImpl &operator=(const ScopedLockImpl &) = delete;
+
+        T &m_mutex;
+        bool m_locked;
+    };
+
+    /**
+     * @brief 互斥量，临界区较长(如I/O)时使用
+     */
+    class Mutex
+    {
+    public:
+        typedef ScopedLockImpl<Mutex> Lock;
+
+        Mutex() {}
+
+        void lock() { m_mutex.lock(); }
+
+        void unlock() { m_mutex.unlock(); }
+
+    private:
+        Mutex(const Mutex &) = delete;
+        Mutex &operator=(const Mutex &) = delete;
+
+        std::mutex m_mutex;
+    };
+
+    /**
+     * @brief 自旋锁，临界区只有几条指令时使用，自旋一段时间后让出CPU
+     */
+    class Spinlock
+    {
+    public:
+        typedef ScopedLockImpl<Spinlock> Lock;
+
+        Spinlock() {}
+
+        void lock()
+        {
+            for (int spins = 0; m_flag.test_and_set(std::memory_order_acquire); ++spins)
+            {
+                if (spins >= 64)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        void unlock() { m_flag.clear(std::memory_order_release); }
+
+    private:
+        Spinlock(const Spinlock &) = delete;
+        Spinlock &operator=(const Spinlock &) = delete;
+
+        std::atomic_flag m_flag = ATOMIC_FLAG_INIT;
+    };
+} // namespace tensir
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef _RCU_H
+#define _RCU_H
+
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+namespace tensir
+{
+    /**
+     * @brief 读多写少数据的RCU同步域
+     * @details 读者在按线程分片的计数器上加一、减一，不加锁也不写共享的缓存行；
+     *          写者发布新数据后调用synchronize()，等待发布前进入的读者全部退出，之后才能释放旧数据。
+     *          计数器按纪元分成两组，写者先翻转纪元再等待旧的一组归零，持续进入的新读者不会让写者饿死。
+     *          读者在读临界区内不能对同一个同步域调用synchronize()，否则会等待自己
+     */
+    class Rcu
+    {
+    public:
+        /// 计数器分片数
+        static const size_t kShards = 16;
+
+        /**
+         * @brief 读临界区，构造时进入，析构时退出，必须在同一线程内析构
+         */
+        class ReadLock
+        {
+        public:
+            ReadLock(Rcu &rcu)
+                : m_rcu(rcu),
+                  m_epoch(rcu.readLock())
+            {
+            }
+
+            ~ReadLock() { m_rcu.readUnlock(m_epoch); }
+
+        private:
+            ReadLock(const ReadLock &) = delete;
+            ReadLock &operator=(const ReadLock &) = delete;
+
+            Rcu &m_rcu;
+            unsigned m_epoch;
+        };
+
+        Rcu()
+            : m_epoch(0)
+        {
+            for (size_t i = 0; i < kShards; ++i)
+            {
+                m_shards[i].count[0].store(0, std::memory_order_relaxed);
+                m_shards[i].count[1].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        /**
+         * @brief 进入读临界区
+         * @return 纪元，退出时传给readUnlock()
+         */
+        unsigned readLock()
+        {
+            unsigned epoch = m_epoch.load(std::memory_order_relaxed) & 1;
+            // seq_cst保证计数先于之后对受保护指针的读取对写者可见
+            m_shards[ShardIndex()].count[epoch].fetch_add(1, std::memory_order_seq_cst);
+            return epoch;
+        }
+
+        /**
+         * @brief 退出读临界区
+         */
+        void readUnlock(unsigned epoch)
+        {
+            m_shards[ShardIndex()].count[epoch].fetch_sub(1, std::memory_order_release);
+        }
+
+        /**
+         * @brief 等待调用前已经进入的读者全部退出
+         * @details 先等上一个纪元中读到旧纪元、翻转后才计数的读者，再翻转纪元并等待当前纪元的读者
+         */
+        void synchronize()
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            unsigned epoch = m_epoch.load(std::memory_order_relaxed);
+            wait(epoch ^ 1);
+            m_epoch.store(epoch ^ 1, std::memory_order_seq_cst);
+            wait(epoch);
+        }
+
+    private:
+        Rcu(const Rcu &) = delete;
+        Rcu &operator=(const Rcu &) = delete;
+
+        /**
+         * @brief 每个线程固定使用一个分片，加一和减一落在同一个计数器上
+         */
+        static size_t ShardIndex()
+        {
+            static std::atomic<size_t> s_next(0);
+            static thread_local size_t t_index = s_next.fetch_add(1, std::memory_order_relaxed) % kShards;
+            return t_index;
+        }
+
+        void wait(unsigned epoch)
+        {
+            for (int spins = 0;; ++spins)
+            {
+                bool idle = true;
+                for (size_t i = 0; i < kShards; ++i)
+                {
+                    if (m_shards[i].count[epoch].load(std::memory_order_seq_cst) != 0)
+                    {
+                        idle = false;
+                        break;
+                    }
+                }
+                if (idle)
+                {
+                    return;
+                }
+                if (spins >= 64)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+    private:
+        /**
+         * @brief 一个分片占一条缓存行
+         */
+        struct Shard
+        {
+            std::atomic<long> count[2];
+            char pad[64 - 2 * sizeof(std::atomic<long>)];
+        };
+
+        /// 当前纪元，只用最低位
+        std::atomic<unsigned> m_epoch;
+        /// 读者计数
+        Shard m_shards[kShards];
+        /// 串行化synchronize()
+        std::mutex m_mutex;
+    };
+
+    /**
+     * @brief RCU保护的指针，读者无锁地访问不可变快照，写者整体替换
+     * @details 写者之间需要自行互斥，替换后旧对象在所有读者退出后才释放
+     */
+    template <class T>
+    class RcuPtr
+    {
+    public:
+        /**
+         * @brief 读者持有的快照，生存期内对象不会被释放
+         */
+        class ReadGuard
+        {
+        public:
+            ReadGuard(const RcuPtr &ptr)
+                : m_lock(ptr.m_rcu),
+                  m_ptr(ptr.m_ptr.load(std::memory_order_seq_cst))
+            {
+            }
+
+            const T *get() const { return m_ptr; }
+            const T *operator->() const { return m_ptr; }
+            const T &operator*() const { return *m_ptr; }
+
+        private:
+            Rcu::ReadLock m_lock;
+            const T *m_ptr;
+        };
+
+        explicit RcuPtr(T *ptr = nullptr)
+            : m_ptr(ptr)
+        {
+        }
+
+        ~RcuPtr() { delete m_ptr.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 返回当前对象，只供持有写者互斥的一方使用
+         */
+        const T *get() const { return m_ptr.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 发布新对象，等待读者退出后释放旧对象
+         */
+        void reset(T *ptr)
+        {
+            delete exchange(ptr);
+        }
+
+        /**
+         * @brief 发布新对象，等待读者退出后把旧对象交给调用者释放
+         * @details 旧对象的析构可能需要加锁时，调用者可以在解锁后再释放
+         */
+        T *exchange(T *ptr)
+        {
+            T *old = m_ptr.exchange(ptr, std::memory_order_seq_cst);
+            m_rcu.synchronize();
+            return old;
+        }
+
+    private:
+        RcuPtr(const RcuPtr &) = delete;
+        RcuPtr &operator=(const RcuPtr &) = delete;
+
+        std::atomic<T *> m_ptr;
+        mutable Rcu m_rcu;
+    };
+} // namespace tensir
+
+#endif
@@ -1,12 +1,36 @@
 #ifndef _UTIL_H
 #define _UTIL_H
 
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
 namespace tensir
 {
-    unsigned int GetThreadId()
+    /**
+     * @brief 获取当前线程的内核线程id(gettid)
+     * @details 每个线程第一次调用时执行一次系统调用，之后返回线程局部的缓存
+     */
+    inline unsigned int GetThreadId()
+    {
+        static thread_local unsigned int t_id = 0;
+        if (!t_id)
+        {
+            t_id = (unsigned int)syscall(SYS_gettid);
+        }
+        return t_id;
+    }
+
+    /**
+     * @brief 获取当前时间(纳秒)，CLOCK_REALTIME
+     */
+    inline uint64_t GetCurrentNS()
     {
-        return 0;
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
     }
 } // namespace tensir
 
-#endif
\ No newline at end of file
+#endif
@@ -1,8 +1,45 @@
 #include "Log.h"
 #include <time.h>
+#include <cstddef>
+#include <type_traits>
+#include <string.h>
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unordered_set>
+#include <cxxabi.h>
+#include <typeinfo>
+#include <math.h>
+#include <stdlib.h>
+#include <stdexcept>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "LogWorker.h"
 
 namespace tensir
 {
+    uint64_t LogLimiter::NextRandom()
+    {
+        static thread_local uint64_t t_state = 0;
+        if (!t_state)
+        {
+            // 每个线程用时间和线程局部变量地址播种，保证非0
+            t_state = (GetCurrentNS() ^ (uint64_t)(uintptr_t)&t_state) | 1;
+        }
+        t_state ^= t_state >> 12;
+        t_state ^= t_state << 25;
+        t_state ^= t_state >> 27;
+        return t_state * 0x2545F4914F6CDD1Dull;
+    }
+
     const char *LogLevel::toString(LogLevel::Level level)
     {
         switch (level)
@@ -47,588 +84,3766 @@ namespace tensir
         return LogLevel::UNKNOWN;
     }
 
-    LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *filename,
-                       uint32_t line, uint32_t elapse, uint32_t thread_id,
-                       uint32_t fiber_id, uint64_t time, const std::string &thread_name)
-        : m_filename(filename),
-          m_line(line),
-          m_elapse(elapse),
-          m_threadId(thread_id),
-          m_fiberId(fiber_id),
-          m_time(time),
-          m_threadName(thread_name),
-          m_logger(logger),
-          m_level(level)
-    {
-    }
-
-    void LogEvent::format(const char *fmt, ...)
+    namespace
     {
-        va_list al;        // 定义可变参数列表指针
-        va_start(al, fmt); // 初始化可变参数指针为第一个参数的地址
-        format(fmt, al);
-        va_end(al); // 清空可变参数指针
-    }
+        /**
+         * @brief 调用点注册表的数据
+         */
+        struct SiteRegistryData
+        {
+            /**
+             * @brief SetEnabled设置的规则
+             */
+            struct Rule
+            {
+                std::string file;
+                int32_t line;
+                bool enabled;
+            };
+
+            std::mutex mutex;
+            std::vector<LogSite *> sites;
+            std::vector<Rule> rules;
+        };
 
-    void LogEvent::format(const char *fmt, va_list al)
-    {
-        char *buf = nullptr;
-        int len = vasprintf(&buf, fmt, al);
+        SiteRegistryData &GetSiteRegistryData()
+        {
+            // 故意不析构：全局或静态对象的析构函数中第一次执行到的调用点仍要注册
+            static SiteRegistryData *s_data = new SiteRegistryData;
+            return *s_data;
+        }
 
-        if (len != -1)
+        bool SiteMatches(const LogSite *site, const std::string &file, int32_t line)
         {
-            m_ss << std::string(buf);
-            free(buf);
+            return (line == 0 || site->getLine() == line) && (file == site->getFile() || file == site->getBasename());
         }
     }
 
-    LogEventWrapper::LogEventWrapper(LogEvent::ptr e)
-        : m_event(e)
+    LogSite::LogSite(const char *file, int32_t line, const char *function, LogLevel::Level level)
+        : m_file(file),
+          m_basename(file),
+          m_line(line),
+          m_function(function),
+          m_level(level),
+          m_enabled(true)
     {
+        const char *slash = strrchr(file, '/');
+        if (slash)
+        {
+            m_basename = slash + 1;
+        }
+        LogSiteRegistry::Register(this);
     }
 
-    LogEventWrapper::~LogEventWrapper()
+    void LogSiteRegistry::Register(LogSite *site)
     {
-        // m_event->getLogger()->log(m_event->getLevel(), m_event);
+        SiteRegistryData &data = GetSiteRegistryData();
+        std::lock_guard<std::mutex> lock(data.mutex);
+        data.sites.push_back(site);
+        site->m_id = data.sites.size();
+        for (auto &i : data.rules)
+        {
+            if (SiteMatches(site, i.file, i.line))
+            {
+                site->setEnabled(i.enabled);
+            }
+        }
     }
 
-    std::stringstream &LogEventWrapper::getSS()
+    LogSite *LogSiteRegistry::Get(uint32_t id)
     {
-        return m_event->getSS();
+        SiteRegistryData &data = GetSiteRegistryData();
+        std::lock_guard<std::mutex> lock(data.mutex);
+        if (id == 0 || id > data.sites.size())
+        {
+            return nullptr;
+        }
+        return data.sites[id - 1];
     }
 
-    LogFormatter::LogFormatter(const std::string &pattern)
-        : m_pattern(pattern)
+    std::vector<LogSite *> LogSiteRegistry::GetSites()
     {
-        init();
+        SiteRegistryData &data = GetSiteRegistryData();
+        std::lock_guard<std::mutex> lock(data.mutex);
+        return data.sites;
     }
 
-    std::string LogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    size_t LogSiteRegistry::SetEnabled(const std::string &file, int32_t line, bool enabled)
     {
-        std::stringstream ss;
-        for (auto &i : m_items)
+        SiteRegistryData &data = GetSiteRegistryData();
+        std::lock_guard<std::mutex> lock(data.mutex);
+        bool found = false;
+        for (auto &i : data.rules)
+        {
+            if (i.file == file && i.line == line)
+            {
+                i.enabled = enabled;
+                found = true;
+            }
+        }
+        if (!found)
         {
-            i->format(ss, logger, level, event);
+            SiteRegistryData::Rule rule = {file, line, enabled};
+            data.rules.push_back(rule);
         }
-        return ss.str();
-    }
 
-    std::ostream &LogFormatter::format(std::ostream &ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
-    {
-        for (auto &i : m_items)
+        size_t count = 0;
+        for (auto i : data.sites)
         {
-            i->format(ofs, logger, level, event);
+            if (SiteMatches(i, file, line))
+            {
+                i->setEnabled(enabled);
+                ++count;
+            }
         }
-        return ofs;
+        return count;
     }
 
-    class MessageFormatItem : public LogFormatter::FormatItem
+    std::atomic<int> LogClock::s_source(LogClock::REALTIME);
+
+    namespace
     {
-    public:
-        MessageFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        /**
+         * @brief TSC换算参数，顺序锁保护：写者前后各把seq加1，读者读到奇数或前后不一致时重读
+         */
+        struct TscCalibration
         {
-            os << event->getContent();
-        }
-    };
+            std::atomic<uint32_t> seq{0};
+            /// 校准点的计数器读数
+            std::atomic<uint64_t> tsc{0};
+            /// 校准点的CLOCK_REALTIME纳秒
+            std::atomic<uint64_t> ns{0};
+            /// 每个计数的纳秒数
+            std::atomic<double> nsPerTick{0.0};
+            /// 串行化写者
+            Mutex mutex;
+            /// 保护第一次校准
+            Mutex initMutex;
+            /// 已经完成第一次校准并添加了后台任务
+            bool scheduled = false;
+        };
 
-    class LevelFormatItem : public LogFormatter::FormatItem
-    {
-    public:
-        LevelFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        TscCalibration &GetTscCalibration()
         {
-            os << LogLevel::toString(level);
+            static TscCalibration *s_calibration = new TscCalibration;
+            return *s_calibration;
         }
-    };
 
-    class ElapseFormatItem : public LogFormatter::FormatItem
-    {
-    public:
-        ElapseFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        /**
+         * @brief 读取一对相邻的(计数器, CLOCK_REALTIME)，取读取窗口最小的一次，计数器取窗口中点
+         */
+        void SampleTsc(uint64_t &tsc, uint64_t &ns)
         {
-            os << event->getElapse();
+            tsc = 0;
+            ns = 0;
+            uint64_t best = UINT64_MAX;
+            for (int i = 0; i < 8; ++i)
+            {
+                uint64_t begin = LogClock::ReadTsc();
+                uint64_t now = GetCurrentNS();
+                uint64_t end = LogClock::ReadTsc();
+                if (end - begin < best)
+                {
+                    best = end - begin;
+                    tsc = begin + (end - begin) / 2;
+                    ns = now;
+                }
+            }
         }
-    };
+    }
 
-    class NameFormatItem : public LogFormatter::FormatItem
+    bool LogClock::IsTscSupported()
     {
-    public:
-        NameFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+#if defined(__x86_64__) || defined(__i386__)
+        // CPUID 0x80000007 EDX bit 8: 恒定速率且不受深度睡眠影响的TSC
+        unsigned int eax, ebx, ecx, edx;
+        __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000000u), "c"(0));
+        if (eax < 0x80000007u)
         {
-            os << event->getLogger()->getName();
+            return false;
         }
-    };
+        __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(0x80000007u), "c"(0));
+        return (edx >> 8) & 1;
+#elif defined(__aarch64__)
+        return true;
+#else
+        return false;
+#endif
+    }
 
-    class ThreadIdFormatItem : public LogFormatter::FormatItem
+    bool LogClock::SetSource(Source source)
     {
-    public:
-        ThreadIdFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        if (source == TSC)
         {
-            os << event->getThreadId();
+            if (!IsTscSupported())
+            {
+                return false;
+            }
+            TscCalibration &cal = GetTscCalibration();
+            Mutex::Lock lock(cal.initMutex);
+            if (!cal.scheduled)
+            {
+                // 第一次校准需要一段基线，之后每秒用上一个校准点做基线修正频率
+                Calibrate();
+                usleep(10 * 1000);
+                Calibrate();
+                LogWorker::Instance().schedule(1000, &LogClock::Calibrate);
+                cal.scheduled = true;
+            }
         }
-    };
+        s_source.store(source, std::memory_order_relaxed);
+        return true;
+    }
 
-    class FiberIdFormatItem : public LogFormatter::FormatItem
+    void LogClock::Calibrate()
     {
-    public:
-        FiberIdFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        TscCalibration &cal = GetTscCalibration();
+        Mutex::Lock lock(cal.mutex);
+        uint64_t tsc = 0;
+        uint64_t ns = 0;
+        SampleTsc(tsc, ns);
+
+        uint64_t prev_tsc = cal.tsc.load(std::memory_order_relaxed);
+        uint64_t prev_ns = cal.ns.load(std::memory_order_relaxed);
+        double ns_per_tick = cal.nsPerTick.load(std::memory_order_relaxed);
+        // 墙上时间被往回调时只移动校准点，沿用原来的频率
+        if (prev_tsc && tsc > prev_tsc && ns > prev_ns)
         {
-            os << event->getFiberId();
+            ns_per_tick = (double)(ns - prev_ns) / (double)(tsc - prev_tsc);
         }
-    };
 
-    class ThreadNameFormatItem : public LogFormatter::FormatItem
+        uint32_t seq = cal.seq.load(std::memory_order_relaxed);
+        cal.seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        cal.tsc.store(tsc, std::memory_order_relaxed);
+        cal.ns.store(ns, std::memory_order_relaxed);
+        cal.nsPerTick.store(ns_per_tick, std::memory_order_relaxed);
+        cal.seq.store(seq + 2, std::memory_order_release);
+    }
+
+    uint64_t LogClock::TscToNanos(uint64_t tsc)
     {
-    public:
-        ThreadNameFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        TscCalibration &cal = GetTscCalibration();
+        uint32_t seq;
+        uint64_t base_tsc, base_ns;
+        double ns_per_tick;
+        do
         {
-            std::cout<< "#"<<event->getThreadName()<<std::endl;
-            os << event->getThreadName();
-        }
-    };
+            seq = cal.seq.load(std::memory_order_acquire);
+            base_tsc = cal.tsc.load(std::memory_order_relaxed);
+            base_ns = cal.ns.load(std::memory_order_relaxed);
+            ns_per_tick = cal.nsPerTick.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ((seq & 1) || seq != cal.seq.load(std::memory_order_relaxed));
+        // 校准之前读取的计数也按同一条直线换算
+        return base_ns + (int64_t)((double)(int64_t)(tsc - base_tsc) * ns_per_tick);
+    }
 
-    class DateTimeFormatItem : public LogFormatter::FormatItem
+    namespace
     {
-    public:
-        DateTimeFormatItem(const std::string &format = "%Y-%m-%d %H:%M:%S")
-            : m_format(format)
+        /**
+         * @brief 读取粗粒度单调时钟(毫秒)
+         */
+        uint64_t MonotonicCoarseMS()
         {
-            if (m_format.empty())
-            {
-                m_format = "%Y-%m-%d %H:%M:%S";
-            }
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+            return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
         }
 
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        /// 进程启动时间，静态初始化时读取
+        const uint64_t s_startMS = MonotonicCoarseMS();
+
+        /**
+         * @brief 驻留的线程名，只增不删，unordered_set的节点不会移动，c_str()一直有效
+         */
+        struct ThreadNames
         {
-            struct tm tm;
-            time_t time = event->getTime();
-            localtime_r(&time, &tm);
-            char buf[64];
-            strftime(buf, sizeof(buf), m_format.c_str(), &tm);
-            os << buf;
+            Mutex mutex;
+            std::unordered_set<std::string> names;
+        };
+
+        ThreadNames &GetThreadNames()
+        {
+            static ThreadNames *s_names = new ThreadNames;
+            return *s_names;
         }
+    }
 
-    private:
-        std::string m_format;
-    };
+    LogThread::LogThread()
+    {
+        static int s_atfork = pthread_atfork(nullptr, nullptr, &LogThread::AfterFork);
+        (void)s_atfork;
+        refresh();
+    }
 
-    class FilenameFormatItem : public LogFormatter::FormatItem
+    LogThread &LogThread::Local()
     {
-    public:
-        FilenameFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
-        {
-            os << event->getFilename();
-        }
-    };
+        static thread_local LogThread t_thread;
+        return t_thread;
+    }
 
-    class LineFormatItem : public LogFormatter::FormatItem
+    const LogThread &LogThread::Current()
     {
-    public:
-        LineFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
-        {
-            os << event->getLine();
-        }
-    };
+        return Local();
+    }
 
-    class NewLineFormatItem : public LogFormatter::FormatItem
+    void LogThread::refresh()
     {
-    public:
-        NewLineFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
+        m_id = (uint32_t)syscall(SYS_gettid);
+        if (pthread_getname_np(pthread_self(), m_buf, sizeof(m_buf)) != 0)
         {
-            os << std::endl;
+            m_buf[0] = '\0';
         }
-    };
+        m_buf[kNameSize - 1] = '\0';
+        m_name = Intern(m_buf);
+    }
 
-    class StringFormatItem : public LogFormatter::FormatItem
+    void LogThread::AfterFork()
     {
-    public:
-        StringFormatItem(const std::string &str)
-            : m_string(str) {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
-        {
-            os << m_string;
-        }
+        Local().refresh();
+    }
 
-    private:
-        std::string m_string;
-    };
+    void LogThread::SetName(const std::string &name)
+    {
+        LogThread &thread = Local();
+        size_t len = std::min(name.size(), kNameSize - 1);
+        memcpy(thread.m_buf, name.data(), len);
+        thread.m_buf[len] = '\0';
+        pthread_setname_np(pthread_self(), thread.m_buf);
+        thread.m_name = Intern(thread.m_buf);
+    }
 
-    class TabFormatItem : public LogFormatter::FormatItem
+    const char *LogThread::Intern(const char *name)
     {
-    public:
-        TabFormatItem(const std::string &str = "") {}
-        void format(std::ostream &os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override
-        {
-            os << "\t";
-        }
+        ThreadNames &names = GetThreadNames();
+        Mutex::Lock lock(names.mutex);
+        return names.names.insert(name).first->c_str();
+    }
 
-    private:
-        std::string m_string;
-    };
+    uint32_t LogThread::GetElapse()
+    {
+        return (uint32_t)(MonotonicCoarseMS() - s_startMS);
+    }
 
-    void LogFormatter::init()
+    LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *filename,
+                       uint32_t line, uint32_t elapse, uint32_t thread_id,
+                       uint32_t fiber_id, uint64_t time, const char *thread_name)
+        : m_logger(logger),
+          m_level(level),
+          m_filename(filename),
+          m_line(line),
+          m_elapse(elapse),
+          m_threadId(thread_id),
+          m_fiberId(fiber_id),
+          m_time(time),
+          m_threadName(LogThread::Intern(thread_name))
+    {
+    }
+
+    void LogEvent::reset(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogSite *site,
+                         const char *filename, uint32_t line, uint32_t elapse, uint32_t thread_id,
+                         uint32_t fiber_id, uint64_t time, const char *thread_name)
     {
+        m_logger = logger;
+        m_level = level;
+        m_site = site;
+        m_filename = filename;
+        m_line = line;
+        m_elapse = elapse;
+        m_threadId = thread_id;
+        m_fiberId = fiber_id;
+        m_time = time;
+        m_threadName = thread_name;
+        m_deferFormat = nullptr;
+        m_fields.clear();
+        m_ss.clear();
+    }
+
+    void LogEvent::release()
+    {
+        m_logger.reset();
+    }
+
+    /**
+     * @brief 线程局部的日志事件池
+     * @details 每个Slot同时容纳LogEvent和shared_ptr的控制块。事件对象只构造一次，反复复用；
+     *          控制块由SlotAllocator分配在Slot内，控制块释放时整个Slot归还给所属线程的池。
+     *          其他线程归还的Slot先压入无锁栈m_remote，由所属线程在本地链表取空时一次性取回。
+     *          线程退出后池被标记为孤儿，最后一个在外的Slot归还时释放整个池；
+     *          此后该线程(如静态对象的析构函数)再创建的事件直接在堆上分配
+     */
+    class LogEventPool
+    {
+    public:
+        struct Slot
+        {
+            Slot *next = nullptr;
+            LogEventPool *owner = nullptr;
+            LogEvent event;
+            /// shared_ptr控制块
+            typename std::aligned_storage<64, alignof(std::max_align_t)>::type block;
+        };
 
         /**
-         * 1. 从左往右扫描，第一个不为%的，用nstr存储普通字符
-         * 2. 碰到第一个%，开始解析，如果下一个为%，当前认定为普通字符，直接append到nstr，否则，进入3
-         * 3. 从%下一个字符开始，直到解析出非alpha，得到当前的格式化类型标记（如d，T等）
-         * 4. 如果当前格式化类型标记紧跟{则认为是格式化模式，例如日期模式{%Y-%m-%d %H:%M:%S}，开始解析日期，否则，直接加入到vec
-         * 5. 对于需要解析日期模式的，需要使用fmt_status标记是否结束扫描{}，fmt_begin记录{位置，来提取出%Y-%m-%d %H:%M:%S
-         * 6. 遍历vec三元组，得到最终的格式项列表，每一个项根据实际情况解析
+         * @brief 在Slot内分配shared_ptr控制块的分配器
          */
-
-        //str, format, type
-        std::vector<std::tuple<std::string, std::string, int> > vec;
-        std::string nstr; // 非格式化串（普通字符串）
-        for (size_t i = 0; i < m_pattern.size(); ++i)
+        template <class T>
+        struct SlotAllocator
         {
-            /**
-             * 开始两个if吃掉m_pattern前面不需要格式化的普通字符串（非%开始的所有字符串）,并保存在nstr中，
-             */
-            if (m_pattern[i] != '%') // 为经过检查的第一个字符，如果不为%直接解析为普通字符
-            {
-                nstr.append(1, m_pattern[i]);
-                continue;
-            }
+            typedef T value_type;
 
-            if ((i + 1) < m_pattern.size() && m_pattern[i + 1] == '%') // 两个%%相邻表示转义，解析为一个%
-            {
-                nstr.append(1, '%');
-                continue;
-            }
+            SlotAllocator(Slot *s) : slot(s) {}
 
-            /**
-             * 遇到%，且%后面为可解析item（不为%），开始做解析
-             */
-            size_t n = i + 1;
-            int fmt_status = 0;   // {}在本程序中为特殊字符，必须成对出现，该flag标记{}是否出错
-            size_t fmt_begin = 0; // item格式开始位置（ "%d{}" 为 '{' 的位置）
+            template <class U>
+            SlotAllocator(const SlotAllocator<U> &o) : slot(o.slot) {}
 
-            std::string str; // item标记（d、T等）
-            std::string fmt; // item格式（仅针对日期才有，其他为空）
-            while (n < m_pattern.size())
+            T *allocate(size_t n)
             {
-                if (!fmt_status && (!isalpha(m_pattern[n]) && m_pattern[n] != '{' && m_pattern[n] != '}')) //解析除日期格式解析的其他项如%T
-                {
-
-                    str = m_pattern.substr(i + 1, n - i - 1);
-                    break;
-                }
-                if (fmt_status == 0)
-                {
-                    if (m_pattern[n] == '{') // item格式开始
-                    {
-                        str = m_pattern.substr(i + 1, n - i - 1);
-                        fmt_status = 1; //解析item格式
-                        fmt_begin = n;
-                        ++n;
-                        continue;
-                    }
-                }
-                else if (fmt_status == 1)
-                {
-                    if (m_pattern[n] == '}') // item格式结束
-                    {
-                        fmt = m_pattern.substr(fmt_begin + 1, n - fmt_begin - 1);
-                        fmt_status = 0;
-                        ++n;
-                        break;
-                    }
-                }
-                ++n;
-                if (n == m_pattern.size())
+                if (sizeof(T) * n <= sizeof(slot->block))
                 {
-                    if (str.empty())
-                    {
-                        str = m_pattern.substr(i + 1);
-                    }
+                    return reinterpret_cast<T *>(&slot->block);
                 }
+                return static_cast<T *>(::operator new(sizeof(T) * n));
             }
 
-            if (fmt_status == 0)
+            void deallocate(T *p, size_t)
             {
-                if (!nstr.empty()) // 开始有普通串，直接加入到vec中，标记为0
+                if ((void *)p == (void *)&slot->block)
                 {
-                    vec.push_back(std::make_tuple(nstr, std::string(), 0));
-                    nstr.clear();
+                    slot->owner->put(slot);
+                }
+                else
+                {
+                    ::operator delete(p);
+                    slot->owner->put(slot);
                 }
-                vec.push_back(std::make_tuple(str, fmt, 1)); // 需要解析的字符串，标记为1
-                i = n - 1;
-            }
-            else if (fmt_status == 1) // {}必须成对存在，否则报错
-            {
-                m_error = true;
-                vec.push_back(std::make_tuple("<<pattern_error>>", fmt, 0));
             }
-        }
 
-        if (!nstr.empty())
+            template <class U>
+            bool operator==(const SlotAllocator<U> &o) const { return slot == o.slot; }
+            template <class U>
+            bool operator!=(const SlotAllocator<U> &o) const { return slot != o.slot; }
+
+            Slot *slot;
+        };
+
+        /**
+         * @brief 引用计数归零时调用，只释放事件持有的引用，不析构事件
+         */
+        struct Recycler
         {
-            vec.push_back(std::make_tuple(nstr, "", 0));
-        }
-        static std::map<std::string, std::function<FormatItem::ptr(const std::string &str)> > s_format_items = {
-#define XX(str, C)                                                               \
-    {                                                                            \
-#str, [](const std::string &fmt) { return FormatItem::ptr(new C(fmt)); } \
-    }
-
-            XX(m, MessageFormatItem),    //m:消息
-            XX(p, LevelFormatItem),      //p:日志级别
-            XX(r, ElapseFormatItem),     //r:累计毫秒数
-            XX(c, NameFormatItem),       //c:日志名称
-            XX(t, ThreadIdFormatItem),   //t:线程id
-            XX(n, NewLineFormatItem),    //n:换行
-            XX(d, DateTimeFormatItem),   //d:时间
-            XX(f, FilenameFormatItem),   //f:文件名
-            XX(l, LineFormatItem),       //l:行号
-            XX(T, TabFormatItem),        //T:Tab
-            XX(F, FiberIdFormatItem),    //F:协程id
-            XX(N, ThreadNameFormatItem), //N:线程名称
-#undef XX
+            void operator()(LogEvent *event) const { event->release(); }
         };
 
-        for (auto &i : vec)
+        /// 本地空闲链表的上限，多出的Slot直接释放
+        static const size_t kMaxFree = 1024;
+
+        LogEventPool() : m_refs(1), m_remote(nullptr) {}
+
+        ~LogEventPool()
         {
-            if (std::get<2>(i) == 0)
-            {
-                m_items.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
+            freeList(m_free);
+            freeList(m_remote.exchange(nullptr, std::memory_order_acquire));
+        }
+
+        /**
+         * @brief 返回当前线程的池，线程的线程局部变量已析构时返回nullptr
+         */
+        static LogEventPool *Local();
+
+        /**
+         * @brief 从当前线程的池取一个事件
+         * @details 线程退出过程中(如静态对象析构时)池已释放，改为直接在堆上分配事件，不再重建池
+         */
+        static LogEvent::ptr Acquire(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogSite *site,
+                                     const char *filename, uint32_t line, uint32_t elapse, uint32_t thread_id,
+                                     uint32_t fiber_id, uint64_t time, const char *thread_name)
+        {
+            LogEventPool *pool = Local();
+            if (TENSIR_LIKELY(pool != nullptr))
+            {
+                return pool->acquire(logger, level, site, filename, line, elapse, thread_id, fiber_id, time, thread_name);
+            }
+            LogEvent::ptr event = std::make_shared<LogEvent>();
+            event->reset(logger, level, site, filename, line, elapse, thread_id, fiber_id, time, thread_name);
+            return event;
+        }
+
+        /**
+         * @brief 当前线程退出，释放本线程的池
+         */
+        static void ThreadExit();
+
+        LogEvent::ptr acquire(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogSite *site,
+                              const char *filename, uint32_t line, uint32_t elapse, uint32_t thread_id,
+                              uint32_t fiber_id, uint64_t time, const char *thread_name)
+        {
+            if (!m_free)
+            {
+                m_free = m_remote.exchange(nullptr, std::memory_order_acquire);
+                m_freeCount = 0;
+                for (Slot *i = m_free; i; i = i->next)
+                {
+                    ++m_freeCount;
+                }
+            }
+
+            Slot *slot = m_free;
+            if (slot)
+            {
+                m_free = slot->next;
+                --m_freeCount;
+            }
+            else
+            {
+                slot = new Slot;
+                slot->owner = this;
+            }
+            m_refs.fetch_add(1, std::memory_order_relaxed);
+
+            slot->event.reset(logger, level, site, filename, line, elapse, thread_id, fiber_id, time, thread_name);
+            return LogEvent::ptr(&slot->event, Recycler(), SlotAllocator<LogEvent>(slot));
+        }
+
+        /**
+         * @brief 归还Slot，可以在任意线程调用
+         */
+        void put(Slot *slot)
+        {
+            if (this == t_pool && m_freeCount < kMaxFree)
+            {
+                slot->next = m_free;
+                m_free = slot;
+                ++m_freeCount;
+            }
+            else if (this == t_pool)
+            {
+                delete slot;
+            }
+            else
+            {
+                Slot *head = m_remote.load(std::memory_order_relaxed);
+                do
+                {
+                    slot->next = head;
+                } while (!m_remote.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+            }
+            unref();
+        }
+
+        /**
+         * @brief 所属线程退出
+         */
+        void orphan()
+        {
+            freeList(m_free);
+            m_free = nullptr;
+            m_freeCount = 0;
+            unref();
+        }
+
+    private:
+        void unref()
+        {
+            if (m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                delete this;
+            }
+        }
+
+        static void freeList(Slot *slot)
+        {
+            while (slot)
+            {
+                Slot *next = slot->next;
+                delete slot;
+                slot = next;
+            }
+        }
+
+    private:
+        /// 所属线程 + 在外的Slot个数
+        std::atomic<size_t> m_refs;
+        /// 其他线程归还的Slot
+        std::atomic<Slot *> m_remote;
+        /// 本地空闲链表，只有所属线程访问
+        Slot *m_free = nullptr;
+        size_t m_freeCount = 0;
+
+        static thread_local LogEventPool *t_pool;
+        /// 当前线程的池已随线程退出释放
+        static thread_local bool t_exited;
+    };
+
+    thread_local LogEventPool *LogEventPool::t_pool = nullptr;
+    thread_local bool LogEventPool::t_exited = false;
+
+    namespace
+    {
+        /**
+         * @brief 线程退出时释放事件池
+         */
+        struct LogEventPoolHolder
+        {
+            ~LogEventPoolHolder()
+            {
+                LogEventPool::ThreadExit();
+            }
+        };
+
+        thread_local LogEventPoolHolder t_poolHolder;
+    }
+
+    LogEventPool *LogEventPool::Local()
+    {
+        if (TENSIR_UNLIKELY(!t_pool))
+        {
+            if (t_exited)
+            {
+                return nullptr;
+            }
+            // 取地址使holder在本线程构造，线程退出时析构
+            (void)&t_poolHolder;
+            t_pool = new LogEventPool;
+        }
+        return t_pool;
+    }
+
+    void LogEventPool::ThreadExit()
+    {
+        t_exited = true;
+        LogEventPool *pool = t_pool;
+        t_pool = nullptr;
+        if (pool)
+        {
+            pool->orphan();
+        }
+    }
+
+    LogEvent::ptr LogEvent::Create(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const char *filename,
+                                   uint32_t line, uint32_t elapse, uint32_t thread_id,
+                                   uint32_t fiber_id, uint64_t time, const char *thread_name)
+    {
+        return LogEventPool::Acquire(logger, level, nullptr, filename, line, elapse, thread_id, fiber_id, time, thread_name);
+    }
+
+    LogEvent::ptr LogEvent::Create(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogSite *site,
+                                   uint32_t elapse, uint32_t thread_id,
+                                   uint32_t fiber_id, uint64_t time, const char *thread_name)
+    {
+        return LogEventPool::Acquire(logger, level, site, nullptr, 0, elapse, thread_id, fiber_id, time, thread_name);
+    }
+
+    LogEvent::ptr LogEvent::Create(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogSite *site)
+    {
+        const LogThread &thread = LogThread::Current();
+        return LogEventPool::Acquire(logger, level, site, nullptr, 0, LogThread::GetElapse(), thread.getId(), 0,
+                                     LogClock::Now(), thread.getName());
+    }
+
+    std::string LogEvent::getContent() const
+    {
+        std::string str;
+        appendContent(str);
+        return str;
+    }
+
+    void LogEvent::appendContent(std::string &out) const
+    {
+        if (m_deferFormat)
+        {
+            LogArgs::Render(out, m_deferFormat, m_ss.data(), m_ss.size());
+        }
+        else
+        {
+            out.append(m_ss.data(), m_ss.size());
+        }
+    }
+
+    void LogEvent::format(const char *fmt, ...)
+    {
+        va_list al;        // 定义可变参数列表指针
+        va_start(al, fmt); // 初始化可变参数指针为第一个参数的地址
+        format(fmt, al);
+        va_end(al); // 清空可变参数指针
+    }
+
+    void LogEvent::format(const char *fmt, va_list al)
+    {
+        m_ss.appendv(fmt, al);
+    }
+
+    LogEventWrapper::LogEventWrapper(LogEvent::ptr &&e)
+        : m_event(std::move(e))
+    {
+    }
+
+    LogEventWrapper::~LogEventWrapper()
+    {
+        m_event->getLogger()->log(m_event->getLevel(), m_event);
+    }
+
+    LogStream &LogEventWrapper::getSS()
+    {
+        return m_event->getSS();
+    }
+
+    LogFormatter::LogFormatter(const std::string &pattern)
+        : m_pattern(pattern)
+    {
+        init();
+    }
+
+    namespace
+    {
+        /**
+         * @brief 将无符号整数转为十进制追加到out
+         */
+        inline void AppendUInt(std::string &out, uint64_t v)
+        {
+            char buf[24];
+            char *p = buf + sizeof(buf);
+            do
+            {
+                *--p = '0' + v % 10;
+                v /= 10;
+            } while (v);
+            out.append(p, buf + sizeof(buf) - p);
+        }
+
+        inline void AppendInt(std::string &out, int64_t v)
+        {
+            if (v < 0)
+            {
+                out.push_back('-');
+                AppendUInt(out, 0 - (uint64_t)v);
+            }
+            else
+            {
+                AppendUInt(out, v);
+            }
+        }
+
+        inline void AppendCStr(std::string &out, const char *str)
+        {
+            if (str)
+            {
+                out.append(str);
+            }
+        }
+
+        /// 当前线程的格式化缓冲是否已析构
+        thread_local bool t_formatBufferDestroyed = false;
+
+        /**
+         * @brief 线程局部的格式化缓冲，避免每次分配
+         */
+        struct FormatBuffer
+        {
+            /// 流式接口使用的格式化缓冲
+            std::string str;
+            /// JSON和logfmt模式下渲染延迟格式化内容的缓冲
+            std::string content;
+
+            ~FormatBuffer() { t_formatBufferDestroyed = true; }
+        };
+
+        thread_local FormatBuffer t_formatBuffer;
+
+        /**
+         * @brief 返回当前线程的格式化缓冲
+         * @details 线程局部变量析构后(如静态对象的析构函数中打日志)返回调用者提供的临时缓冲
+         */
+        inline std::string &GetFormatBuffer(std::string &fallback)
+        {
+            return TENSIR_UNLIKELY(t_formatBufferDestroyed) ? fallback : t_formatBuffer.str;
+        }
+
+        /**
+         * @brief 返回当前线程渲染延迟格式化内容的缓冲，析构后返回调用者提供的临时缓冲
+         */
+        inline std::string &GetContentBuffer(std::string &fallback)
+        {
+            return TENSIR_UNLIKELY(t_formatBufferDestroyed) ? fallback : t_formatBuffer.content;
+        }
+
+        /**
+         * @brief 返回第一个需要转义的字符的位置，没有时返回n
+         * @details JSON需要转义控制字符、'"'和'\\'；logfmt的值另外遇到空格和'='时需要加引号。
+         *          有SSE2时每次比较16字节
+         */
+        template <bool kLogfmt>
+        size_t ScanSpecial(const char *s, size_t n)
+        {
+            const unsigned char limit = kLogfmt ? 0x20 : 0x1f;
+            size_t i = 0;
+#ifdef __SSE2__
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i equal = _mm_set1_epi8('=');
+            const __m128i max = _mm_set1_epi8((char)limit);
+            for (; i + 16 <= n; i += 16)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+                __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash));
+                // 无符号比较v <= limit，等价于min(v, limit) == v
+                m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_min_epu8(v, max), v));
+                if (kLogfmt)
+                {
+                    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, equal));
+                }
+                int mask = _mm_movemask_epi8(m);
+                if (mask)
+                {
+                    return i + __builtin_ctz(mask);
+                }
+            }
+#endif
+            for (; i < n; ++i)
+            {
+                unsigned char c = s[i];
+                if (c <= limit || c == '"' || c == '\\' || (kLogfmt && c == '='))
+                {
+                    return i;
+                }
+            }
+            return n;
+        }
+
+        /**
+         * @brief 按JSON字符串的规则转义后追加到out，不含两端的引号
+         */
+        void AppendEscaped(std::string &out, const char *s, size_t n)
+        {
+            static const char kHex[] = "0123456789abcdef";
+            size_t begin = 0;
+            while (begin < n)
+            {
+                size_t i = begin + ScanSpecial<false>(s + begin, n - begin);
+                out.append(s + begin, i - begin);
+                if (i == n)
+                {
+                    break;
+                }
+                unsigned char c = s[i];
+                switch (c)
+                {
+                case '"':
+                    out.append("\\\"", 2);
+                    break;
+                case '\\':
+                    out.append("\\\\", 2);
+                    break;
+                case '\n':
+                    out.append("\\n", 2);
+                    break;
+                case '\r':
+                    out.append("\\r", 2);
+                    break;
+                case '\t':
+                    out.append("\\t", 2);
+                    break;
+                default:
+                {
+                    char buf[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 15]};
+                    out.append(buf, sizeof(buf));
+                    break;
+                }
+                }
+                begin = i + 1;
+            }
+        }
+
+        /**
+         * @brief 追加JSON字符串，含两端的引号
+         */
+        void AppendJsonString(std::string &out, const char *s, size_t n)
+        {
+            out.push_back('"');
+            AppendEscaped(out, s, n);
+            out.push_back('"');
+        }
+
+        /**
+         * @brief 追加logfmt的值，含空格、'='、引号或控制字符以及空串时加引号并转义
+         */
+        void AppendLogfmtString(std::string &out, const char *s, size_t n)
+        {
+            if (n && ScanSpecial<true>(s, n) == n)
+            {
+                out.append(s, n);
+            }
+            else
+            {
+                AppendJsonString(out, s, n);
+            }
+        }
+
+        /**
+         * @brief 追加浮点数，取%.15g到%.17g中能精确还原的最短结果
+         * @param[in] json 为true时NaN和无穷输出为null
+         */
+        void AppendDouble(std::string &out, double v, bool json)
+        {
+            if (json && !std::isfinite(v))
+            {
+                out.append("null", 4);
+                return;
+            }
+            char buf[32];
+            int n = snprintf(buf, sizeof(buf), "%.15g", v);
+            for (int precision = 16; precision <= 17 && std::isfinite(v) && strtod(buf, nullptr) != v; ++precision)
+            {
+                n = snprintf(buf, sizeof(buf), "%.*g", precision, v);
+            }
+            out.append(buf, n);
+        }
+
+        /**
+         * @brief 追加一个结构化字段的值
+         */
+        void AppendFieldValue(std::string &out, const LogArgs::Value &value, bool json)
+        {
+            switch (value.tag)
+            {
+            case LogArgs::INT32:
+            case LogArgs::INT64:
+                AppendInt(out, (int64_t)value.bits);
+                break;
+            case LogArgs::UINT32:
+            case LogArgs::UINT64:
+                AppendUInt(out, value.bits);
+                break;
+            case LogArgs::BOOL:
+                out.append(value.bits ? "true" : "false");
+                break;
+            case LogArgs::DOUBLE:
+                AppendDouble(out, value.real, json);
+                break;
+            case LogArgs::POINTER:
+            {
+                char buf[24];
+                int n = snprintf(buf, sizeof(buf), json ? "\"0x%llx\"" : "0x%llx", (unsigned long long)value.bits);
+                out.append(buf, n);
+                break;
+            }
+            case LogArgs::STRING:
+                if (json)
+                {
+                    AppendJsonString(out, value.str, value.len);
+                }
+                else
+                {
+                    AppendLogfmtString(out, value.str, value.len);
+                }
+                break;
+            }
+        }
+
+        /**
+         * @brief 追加日志内容，流式内容直接转义，延迟格式化的内容先渲染到线程局部缓冲
+         */
+        void AppendContent(std::string &out, const LogEvent &event, bool json)
+        {
+            const char *data = event.getSS().data();
+            size_t len = event.getSS().size();
+            std::string fallback;
+            if (event.isDeferred())
+            {
+                std::string &buf = GetContentBuffer(fallback);
+                buf.clear();
+                event.appendContent(buf);
+                data = buf.data();
+                len = buf.size();
+            }
+            if (json)
+            {
+                AppendJsonString(out, data, len);
+            }
+            else
+            {
+                AppendLogfmtString(out, data, len);
+            }
+        }
+
+        /**
+         * @brief 按logfmt追加所有结构化字段，每个字段前有一个空格
+         */
+        void AppendLogfmtFields(std::string &out, const LogEvent &event)
+        {
+            const std::string &fields = event.getFields();
+            LogArgs::Reader reader(fields.data(), fields.size());
+            LogArgs::Value key, value;
+            while (reader.next(key) && key.tag == LogArgs::STRING && reader.next(value))
+            {
+                out.push_back(' ');
+                out.append(key.str, key.len);
+                out.push_back('=');
+                AppendFieldValue(out, value, false);
+            }
+        }
+
+        /// 小数秒占位符
+        const char kFractionMark = '\x01';
+
+        /**
+         * @brief 某个时间格式在某一秒的渲染结果
+         */
+        struct DateCache
+        {
+            uint64_t id = 0;
+            int64_t sec = -1;
+            char text[128];
+            uint8_t len = 0;
+            uint8_t count = 0;
+            /// 小数秒的位置与位数
+            uint8_t pos[4];
+            uint8_t digits[4];
+        };
+
+        thread_local DateCache t_dateCaches[8];
+
+        std::atomic<uint64_t> s_dateFormatId(0);
+
+        /**
+         * @brief 将%N、%3N等小数秒替换为对应个数的占位符
+         */
+        std::string CompileDateFormat(const std::string &fmt)
+        {
+            std::string str;
+            for (size_t i = 0; i < fmt.size(); ++i)
+            {
+                if (fmt[i] != '%' || i + 1 == fmt.size())
+                {
+                    str.append(1, fmt[i]);
+                    continue;
+                }
+                char c = fmt[i + 1];
+                if (c == 'N')
+                {
+                    str.append(9, kFractionMark);
+                    ++i;
+                }
+                else if (c >= '1' && c <= '9' && i + 2 < fmt.size() && fmt[i + 2] == 'N')
+                {
+                    str.append(c - '0', kFractionMark);
+                    i += 2;
+                }
+                else
+                {
+                    str.append(fmt, i, 2);
+                    ++i;
+                }
+            }
+            return str;
+        }
+    }
+
+    std::string LogFormatter::format(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event)
+    {
+        std::string str;
+        format(str, logger.get(), level, *event);
+        return str;
+    }
+
+    std::ostream &LogFormatter::format(std::ostream &ofs, const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event)
+    {
+        std::string fallback;
+        std::string &buf = GetFormatBuffer(fallback);
+        buf.clear();
+        format(buf, logger.get(), level, *event);
+        ofs.write(buf.data(), buf.size());
+        return ofs;
+    }
+
+    void LogFormatter::format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent &event) const
+    {
+        for (const Instruction &i : m_program)
+        {
+            switch (i.op)
+            {
+            case OP_LITERAL:
+                out.append(m_literals, i.offset, i.len);
+                break;
+            case OP_MESSAGE:
+                event.appendContent(out);
+                break;
+            case OP_LEVEL:
+                out.append(LogLevel::toString(level));
+                break;
+            case OP_ELAPSE:
+                AppendUInt(out, event.getElapse());
+                break;
+            case OP_NAME:
+            {
+                Logger *l = event.getLogger() ? event.getLogger().get() : logger;
+                if (l)
+                {
+                    out.append(l->getName());
+                }
+                break;
+            }
+            case OP_THREAD_ID:
+                AppendUInt(out, event.getThreadId());
+                break;
+            case OP_DATETIME:
+                formatDateTime(out, m_dateFormats[i.offset], event.getTimestamp());
+                break;
+            case OP_FILENAME:
+                AppendCStr(out, event.getFilename());
+                break;
+            case OP_LINE:
+                AppendInt(out, event.getLine());
+                break;
+            case OP_FIBER_ID:
+                AppendUInt(out, event.getFiberId());
+                break;
+            case OP_THREAD_NAME:
+                AppendCStr(out, event.getThreadName());
+                break;
+            case OP_FIELDS:
+                AppendLogfmtFields(out, event);
+                break;
+            case OP_JSON:
+                formatJson(out, logger, level, event, m_dateFormats[i.offset]);
+                break;
+            case OP_LOGFMT:
+                formatLogfmt(out, logger, level, event, m_dateFormats[i.offset]);
+                break;
+            }
+        }
+    }
+
+    void LogFormatter::formatJson(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent &event,
+                                  const DateFormat &date) const
+    {
+        Logger *l = event.getLogger() ? event.getLogger().get() : logger;
+        const char *file = event.getFilename();
+        const char *thread = event.getThreadName();
+
+        out.append("{\"time\":\"", 9);
+        formatDateTime(out, date, event.getTimestamp());
+        out.append("\",\"level\":\"", 11);
+        out.append(LogLevel::toString(level));
+        out.append("\",\"logger\":", 11);
+        if (l)
+        {
+            AppendJsonString(out, l->getName().data(), l->getName().size());
+        }
+        else
+        {
+            out.append("\"\"", 2);
+        }
+        out.append(",\"tid\":", 7);
+        AppendUInt(out, event.getThreadId());
+        out.append(",\"thread\":", 10);
+        AppendJsonString(out, thread, thread ? strlen(thread) : 0);
+        out.append(",\"file\":", 8);
+        AppendJsonString(out, file, file ? strlen(file) : 0);
+        out.append(",\"line\":", 8);
+        AppendInt(out, event.getLine());
+        out.append(",\"msg\":", 7);
+        AppendContent(out, event, true);
+
+        const std::string &fields = event.getFields();
+        LogArgs::Reader reader(fields.data(), fields.size());
+        LogArgs::Value key, value;
+        while (reader.next(key) && key.tag == LogArgs::STRING && reader.next(value))
+        {
+            out.push_back(',');
+            AppendJsonString(out, key.str, key.len);
+            out.push_back(':');
+            AppendFieldValue(out, value, true);
+        }
+        out.append("}\n", 2);
+    }
+
+    void LogFormatter::formatLogfmt(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent &event,
+                                    const DateFormat &date) const
+    {
+        Logger *l = event.getLogger() ? event.getLogger().get() : logger;
+        const char *file = event.getFilename();
+        const char *thread = event.getThreadName();
+
+        out.append("time=", 5);
+        formatDateTime(out, date, event.getTimestamp());
+        out.append(" level=", 7);
+        out.append(LogLevel::toString(level));
+        out.append(" logger=", 8);
+        if (l)
+        {
+            AppendLogfmtString(out, l->getName().data(), l->getName().size());
+        }
+        else
+        {
+            out.append("\"\"", 2);
+        }
+        out.append(" tid=", 5);
+        AppendUInt(out, event.getThreadId());
+        out.append(" thread=", 8);
+        AppendLogfmtString(out, thread, thread ? strlen(thread) : 0);
+        out.append(" file=", 6);
+        AppendLogfmtString(out, file, file ? strlen(file) : 0);
+        out.append(" line=", 6);
+        AppendInt(out, event.getLine());
+        out.append(" msg=", 5);
+        AppendContent(out, event, false);
+        AppendLogfmtFields(out, event);
+        out.push_back('\n');
+    }
+
+    void LogFormatter::formatDateTime(std::string &out, const DateFormat &fmt, uint64_t timestamp) const
+    {
+        int64_t sec = timestamp / 1000000000ull;
+        uint32_t nsec = timestamp % 1000000000ull;
+
+        DateCache &cache = t_dateCaches[fmt.id & 7];
+        if (cache.id != fmt.id || cache.sec != sec)
+        {
+            struct tm tm;
+            time_t time = sec;
+            localtime_r(&time, &tm);
+            cache.len = strftime(cache.text, sizeof(cache.text), fmt.pattern.c_str(), &tm);
+            cache.count = 0;
+            for (uint8_t i = 0; i < cache.len && cache.count < 4;)
+            {
+                if (cache.text[i] != kFractionMark)
+                {
+                    ++i;
+                    continue;
+                }
+                uint8_t begin = i;
+                while (i < cache.len && cache.text[i] == kFractionMark)
+                {
+                    ++i;
+                }
+                cache.pos[cache.count] = begin;
+                cache.digits[cache.count] = i - begin > 9 ? 9 : i - begin;
+                ++cache.count;
+            }
+            cache.id = fmt.id;
+            cache.sec = sec;
+        }
+
+        size_t begin = out.size();
+        out.append(cache.text, cache.len);
+        for (uint8_t i = 0; i < cache.count; ++i)
+        {
+            char *p = &out[begin + cache.pos[i]];
+            uint32_t v = nsec;
+            for (int j = cache.digits[i]; j < 9; ++j)
+            {
+                v /= 10;
+            }
+            for (int j = cache.digits[i] - 1; j >= 0; --j)
+            {
+                p[j] = '0' + v % 10;
+                v /= 10;
+            }
+        }
+    }
+
+    void LogFormatter::init()
+    {
+
+        /**
+         * 1. 从左往右扫描，第一个不为%的，用nstr存储普通字符
+         * 2. 碰到第一个%，开始解析，如果下一个为%，当前认定为普通字符，直接append到nstr，否则，进入3
+         * 3. 从%下一个字符开始，直到解析出非alpha，得到当前的格式化类型标记（如d，T等）
+         * 4. 如果当前格式化类型标记紧跟{则认为是格式化模式，例如日期模式{%Y-%m-%d %H:%M:%S}，开始解析日期，否则，直接加入到vec
+         * 5. 对于需要解析日期模式的，需要使用fmt_status标记是否结束扫描{}，fmt_begin记录{位置，来提取出%Y-%m-%d %H:%M:%S
+         * 6. 遍历vec三元组，得到最终的格式项列表，每一个项根据实际情况解析
+         */
+
+        m_program.clear();
+        m_literals.clear();
+        m_dateFormats.clear();
+        if (m_pattern == "json" || m_pattern == "logfmt")
+        {
+            // 整行输出，时间为带时区的ISO 8601，纳秒精度
+            DateFormat date = {++s_dateFormatId, CompileDateFormat("%Y-%m-%dT%H:%M:%S.%N%z")};
+            m_dateFormats.push_back(date);
+            Instruction ins = {(uint32_t)(m_pattern == "json" ? OP_JSON : OP_LOGFMT), 0, 0};
+            m_program.push_back(ins);
+            return;
+        }
+
+        //str, format, type
+        std::vector<std::tuple<std::string, std::string, int> > vec;
+        std::string nstr; // 非格式化串（普通字符串）
+        for (size_t i = 0; i < m_pattern.size(); ++i)
+        {
+            /**
+             * 开始两个if吃掉m_pattern前面不需要格式化的普通字符串（非%开始的所有字符串）,并保存在nstr中，
+             */
+            if (m_pattern[i] != '%') // 为经过检查的第一个字符，如果不为%直接解析为普通字符
+            {
+                nstr.append(1, m_pattern[i]);
+                continue;
+            }
+
+            if ((i + 1) < m_pattern.size() && m_pattern[i + 1] == '%') // 两个%%相邻表示转义，解析为一个%
+            {
+                nstr.append(1, '%');
+                ++i;
+                continue;
+            }
+
+            /**
+             * 遇到%，且%后面为可解析item（不为%），开始做解析
+             */
+            size_t n = i + 1;
+            int fmt_status = 0;   // {}在本程序中为特殊字符，必须成对出现，该flag标记{}是否出错
+            size_t fmt_begin = 0; // item格式开始位置（ "%d{}" 为 '{' 的位置）
+
+            std::string str; // item标记（d、T等）
+            std::string fmt; // item格式（仅针对日期才有，其他为空）
+            while (n < m_pattern.size())
+            {
+                if (!fmt_status && (!isalpha(m_pattern[n]) && m_pattern[n] != '{' && m_pattern[n] != '}')) //解析除日期格式解析的其他项如%T
+                {
+
+                    str = m_pattern.substr(i + 1, n - i - 1);
+                    break;
+                }
+                if (fmt_status == 0)
+                {
+                    if (m_pattern[n] == '{') // item格式开始
+                    {
+                        str = m_pattern.substr(i + 1, n - i - 1);
+                        fmt_status = 1; //解析item格式
+                        fmt_begin = n;
+                        ++n;
+                        continue;
+                    }
+                }
+                else if (fmt_status == 1)
+                {
+                    if (m_pattern[n] == '}') // item格式结束
+                    {
+                        fmt = m_pattern.substr(fmt_begin + 1, n - fmt_begin - 1);
+                        fmt_status = 0;
+                        ++n;
+                        break;
+                    }
+                }
+                ++n;
+                if (n == m_pattern.size())
+                {
+                    if (str.empty())
+                    {
+                        str = m_pattern.substr(i + 1);
+                    }
+                }
+            }
+
+            if (fmt_status == 0)
+            {
+                if (!nstr.empty()) // 开始有普通串，直接加入到vec中，标记为0
+                {
+                    vec.push_back(std::make_tuple(nstr, std::string(), 0));
+                    nstr.clear();
+                }
+                vec.push_back(std::make_tuple(str, fmt, 1)); // 需要解析的字符串，标记为1
+                i = n - 1;
+            }
+            else if (fmt_status == 1) // {}必须成对存在，否则报错
+            {
+                m_error = true;
+                vec.push_back(std::make_tuple("<<pattern_error>>", fmt, 0));
+            }
+        }
+
+        if (!nstr.empty())
+        {
+            vec.push_back(std::make_tuple(nstr, "", 0));
+        }
+        static const std::map<std::string, Opcode> s_opcodes = {
+#define XX(str, op) \
+    {               \
+#str, op        \
+    }
+
+            XX(m, OP_MESSAGE),     //m:消息
+            XX(p, OP_LEVEL),       //p:日志级别
+            XX(r, OP_ELAPSE),      //r:累计毫秒数
+            XX(c, OP_NAME),        //c:日志名称
+            XX(t, OP_THREAD_ID),   //t:线程id
+            XX(d, OP_DATETIME),    //d:时间
+            XX(f, OP_FILENAME),    //f:文件名
+            XX(l, OP_LINE),        //l:行号
+            XX(F, OP_FIBER_ID),    //F:协程id
+            XX(N, OP_THREAD_NAME), //N:线程名称
+            XX(K, OP_FIELDS),      //K:结构化字段
+#undef XX
+        };
+
+        /**
+         * 编译：普通字符串、%n、%T以及错误提示都是常量，先攒在literal中，
+         * 遇到需要运行时求值的项时再作为一条字面量指令写出，保证相邻常量只占一条指令
+         */
+        std::string literal;
+        auto flush_literal = [this, &literal]() {
+            if (!literal.empty())
+            {
+                Instruction ins = {OP_LITERAL, (uint32_t)m_literals.size(), (uint32_t)literal.size()};
+                m_literals.append(literal);
+                m_program.push_back(ins);
+                literal.clear();
+            }
+        };
+
+        for (auto &i : vec)
+        {
+            const std::string &str = std::get<0>(i);
+            if (std::get<2>(i) == 0)
+            {
+                literal.append(str);
+                continue;
+            }
+
+            if (str == "n") //n:换行
+            {
+                literal.append(1, '\n');
+                continue;
+            }
+            if (str == "T") //T:Tab
+            {
+                literal.append(1, '\t');
+                continue;
+            }
+
+            auto it = s_opcodes.find(str);
+            if (it == s_opcodes.end())
+            {
+                literal.append("<<error_format %" + str + ">>");
+                m_error = true;
+                continue;
+            }
+
+            flush_literal();
+            Instruction ins = {(uint32_t)it->second, 0, 0};
+            if (it->second == OP_DATETIME)
+            {
+                const std::string &fmt = std::get<1>(i);
+                DateFormat date = {++s_dateFormatId, CompileDateFormat(fmt.empty() ? "%Y-%m-%d %H:%M:%S" : fmt)};
+                ins.offset = m_dateFormats.size();
+                m_dateFormats.push_back(date);
+            }
+            m_program.push_back(ins);
+        }
+        flush_literal();
+    }
+
+    std::atomic<uint32_t> LogMetrics::s_timingInterval(16);
+
+    namespace
+    {
+        /// Logger::callAppenders是否在对当前这条日志计时
+        thread_local bool t_callTiming = false;
+        /// 当前线程正在调用的日志目标累计的格式化耗时和字节数，由Logger::callAppenders归到日志器
+        thread_local uint64_t t_callFormatTime = 0;
+        thread_local uint64_t t_callBytes = 0;
+
+        std::atomic<size_t> s_metricsThreads(0);
+    }
+
+    uint64_t LogMetrics::Histogram::percentile(double p) const
+    {
+        if (!count)
+        {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(p * count);
+        rank = rank < count ? rank : count - 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i)
+        {
+            seen += buckets[i];
+            if (seen > rank)
+            {
+                return i ? 1ull << i : 0;
+            }
+        }
+        return 1ull << (kBuckets - 1);
+    }
+
+    LogMetrics::LogMetrics()
+        : m_storage(new char[sizeof(Shard) * kShards + alignof(Shard)])
+    {
+        uintptr_t p = (uintptr_t)m_storage.get();
+        p = (p + alignof(Shard) - 1) & ~(uintptr_t)(alignof(Shard) - 1);
+        memset((void *)p, 0, sizeof(Shard) * kShards);
+        m_shards = new ((void *)p) Shard[kShards];
+    }
+
+    size_t LogMetrics::ShardIndex()
+    {
+        static thread_local size_t t_index = s_metricsThreads.fetch_add(1, std::memory_order_relaxed) % kShards;
+        return t_index;
+    }
+
+    LogMetrics::Snapshot LogMetrics::snapshot() const
+    {
+        Snapshot snap;
+        for (size_t i = 0; i < kShards; ++i)
+        {
+            const Counters &c = m_shards[i].counters;
+            snap.accepted += c.accepted.load(std::memory_order_relaxed);
+            snap.filtered += c.filtered.load(std::memory_order_relaxed);
+            snap.dropped += c.dropped.load(std::memory_order_relaxed);
+            snap.bytes += c.bytes.load(std::memory_order_relaxed);
+            for (size_t j = 0; j < kBuckets; ++j)
+            {
+                uint64_t format = c.format[j].load(std::memory_order_relaxed);
+                uint64_t write = c.write[j].load(std::memory_order_relaxed);
+                snap.formatTime.buckets[j] += format;
+                snap.formatTime.count += format;
+                snap.writeTime.buckets[j] += write;
+                snap.writeTime.count += write;
+            }
+            snap.formatTime.sum += c.formatSum.load(std::memory_order_relaxed);
+            snap.writeTime.sum += c.writeSum.load(std::memory_order_relaxed);
+        }
+        return snap;
+    }
+
+    void LogAppender::formatEvent(const LogFormatter &formatter, std::string &out, Logger *logger, LogLevel::Level level,
+                                  const LogEvent &event)
+    {
+        size_t pos = out.size();
+        if (t_callTiming)
+        {
+            uint64_t begin = LogMetrics::Now();
+            formatter.format(out, logger, level, event);
+            uint64_t ns = LogMetrics::Now() - begin;
+            m_metrics.addFormatTime(ns);
+            t_callFormatTime += ns;
+        }
+        else
+        {
+            formatter.format(out, logger, level, event);
+        }
+        addWritten(out.size() - pos);
+    }
+
+    void LogAppender::addWritten(size_t len)
+    {
+        m_metrics.addBytes(len);
+        t_callBytes += len;
+    }
+
+    void LogAppender::setFormatter(LogFormatter::ptr val)
+    {
+        MutexType::Lock lock(m_mutex);
+        m_formatter = val;
+        if (m_formatter)
+        {
+            m_hasFormatter = true;
+        }
+        else
+        {
+            m_hasFormatter = false;
+        }
+    }
+
+    LogFormatter::ptr LogAppender::getFormatter()
+    {
+        MutexType::Lock lock(m_mutex);
+        return m_formatter;
+    }
+
+    /**
+     * @brief 单生产者单消费者的有界环形队列
+     * @details head只由生产线程写，tail只由消费线程写，两者分处不同缓存行
+     */
+    class LogDispatcher::Ring
+    {
+    public:
+        struct Record
+        {
+            Logger::ptr logger;
+            LogLevel::Level level;
+            LogEvent::ptr event;
+        };
+
+        Ring(size_t capacity)
+            : m_mask(capacity - 1),
+              m_records(capacity),
+              m_head(0),
+              m_tail(0),
+              m_closed(false),
+              m_detached(false)
+        {
+        }
+
+        bool tryPush(Logger::ptr &logger, LogLevel::Level level, LogEvent::ptr &event)
+        {
+            uint64_t head = m_head.load(std::memory_order_relaxed);
+            if (head - m_cachedTail > m_mask)
+            {
+                m_cachedTail = m_tail.load(std::memory_order_acquire);
+                if (head - m_cachedTail > m_mask)
+                {
+                    return false;
+                }
+            }
+            Record &r = m_records[head & m_mask];
+            r.logger.swap(logger);
+            r.level = level;
+            r.event.swap(event);
+            m_head.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        template <class F>
+        size_t consume(F f, size_t max)
+        {
+            uint64_t tail = m_tail.load(std::memory_order_relaxed);
+            uint64_t head = m_head.load(std::memory_order_acquire);
+            size_t n = 0;
+            while (tail != head && n < max)
+            {
+                Record &r = m_records[tail & m_mask];
+                f(r);
+                r.logger.reset();
+                r.event.reset();
+                ++tail;
+                ++n;
+            }
+            if (n)
+            {
+                m_tail.store(tail, std::memory_order_release);
+            }
+            return n;
+        }
+
+        uint64_t head() const { return m_head.load(std::memory_order_acquire); }
+        uint64_t tail() const { return m_tail.load(std::memory_order_acquire); }
+        bool empty() const { return head() == tail(); }
+
+        /// 生产线程退出
+        void close() { m_closed.store(true, std::memory_order_release); }
+        bool isClosed() const { return m_closed.load(std::memory_order_acquire); }
+
+        /// 分发器已停止
+        void detach() { m_detached.store(true, std::memory_order_release); }
+        bool isDetached() const { return m_detached.load(std::memory_order_acquire); }
+
+    private:
+        const size_t m_mask;
+        std::vector<Record> m_records;
+        char m_pad0[64];
+        /// 生产者写入位置
+        std::atomic<uint64_t> m_head;
+        /// 生产者缓存的消费位置，减少对m_tail的读取
+        uint64_t m_cachedTail = 0;
+        char m_pad1[64];
+        /// 消费者读取位置
+        std::atomic<uint64_t> m_tail;
+        char m_pad2[64];
+        std::atomic<bool> m_closed;
+        std::atomic<bool> m_detached;
+    };
+
+    namespace
+    {
+        /// 当前线程的队列表是否已析构
+        thread_local bool t_localRingsDestroyed = false;
+
+        /**
+         * @brief 当前线程在各分发器中的队列，线程退出时关闭队列
+         */
+        struct LocalRings
+        {
+            std::vector<std::pair<uint64_t, std::shared_ptr<LogDispatcher::Ring> > > rings;
+
+            ~LocalRings()
+            {
+                t_localRingsDestroyed = true;
+                for (auto &i : rings)
+                {
+                    i.second->close();
+                }
+            }
+        };
+
+        thread_local LocalRings t_localRings;
+        thread_local bool t_inConsumer = false;
+        std::atomic<uint64_t> s_dispatcherId(0);
+
+        /// 两次报告丢弃条数的最小间隔(纳秒)
+        const uint64_t kDropReportInterval = 1000000000ull;
+
+        /**
+         * @brief 生成报告丢弃条数的日志事件
+         */
+        LogEvent::ptr CreateDroppedEvent(const Logger::ptr &logger, uint64_t count)
+        {
+            const LogThread &thread = LogThread::Current();
+            LogEvent::ptr event = LogEvent::Create(logger, LogLevel::WARN, __FILE__, __LINE__, LogThread::GetElapse(),
+                                                   thread.getId(), 0, LogClock::Now(), thread.getName());
+            event->getSS() << count << " log messages dropped";
+            return event;
+        }
+    }
+
+    LogDispatcher::LogDispatcher(size_t ring_capacity)
+        : m_id(++s_dispatcherId),
+          m_capacity(2),
+          m_dropped(0),
+          m_version(0),
+          m_sleeping(false),
+          m_running(true)
+    {
+        while (m_capacity < ring_capacity)
+        {
+            m_capacity <<= 1;
+        }
+        m_thread = std::thread(&LogDispatcher::consume, this);
+    }
+
+    LogDispatcher::~LogDispatcher()
+    {
+        stop();
+    }
+
+    bool LogDispatcher::InConsumer()
+    {
+        return t_inConsumer;
+    }
+
+    LogDispatcher::Ring *LogDispatcher::localRing()
+    {
+        auto &rings = t_localRings.rings;
+        for (auto &i : rings)
+        {
+            if (i.first == m_id)
+            {
+                return i.second.get();
+            }
+        }
+
+        // 顺便清理已停止的分发器留下的队列
+        for (auto it = rings.begin(); it != rings.end();)
+        {
+            if (it->second->isDetached())
+            {
+                it = rings.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        std::shared_ptr<Ring> ring(new Ring(m_capacity));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_rings.push_back(ring);
+            m_version.fetch_add(1, std::memory_order_release);
+        }
+        rings.push_back(std::make_pair(m_id, ring));
+        return ring.get();
+    }
+
+    bool LogDispatcher::post(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        // 线程退出过程中(如静态对象的析构函数)队列已关闭，由调用者同步输出
+        if (!m_running.load(std::memory_order_relaxed) || TENSIR_UNLIKELY(t_localRingsDestroyed))
+        {
+            return false;
+        }
+
+        Ring *ring = localRing();
+        if (!ring->tryPush(logger, level, event))
+        {
+            LogOverflowPolicy policy = getOverflowPolicy();
+            std::chrono::steady_clock::time_point deadline =
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(policy.timeout);
+            while (!ring->tryPush(logger, level, event))
+            {
+                if (!m_running.load(std::memory_order_relaxed))
+                {
+                    return false;
+                }
+                if (!policy.shouldWait(level) ||
+                    (policy.action == LogOverflowPolicy::BLOCK_TIMEOUT && std::chrono::steady_clock::now() >= deadline))
+                {
+                    m_dropped.fetch_add(1, std::memory_order_relaxed);
+                    logger->getMetrics().addDropped();
+                    return true;
+                }
+                m_cond.notify_one();
+                std::this_thread::yield();
+            }
+        }
+
+        // 与消费线程设置m_sleeping后检查队列配对，避免丢失唤醒
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!m_running.load(std::memory_order_relaxed))
+        {
+            // 入队前stop()已开始，消费线程可能已做完最后一轮消费，由本线程输出
+            drainStopped(ring);
+            return true;
+        }
+        if (m_sleeping.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cond.notify_one();
+        }
+        return true;
+    }
+
+    void LogDispatcher::drainStopped(Ring *ring)
+    {
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_drainMutex);
+                if (m_stopped)
+                {
+                    while (ring->consume([](Ring::Record &r) {
+                        r.logger->callAppenders(r.level, r.event);
+                    }, 256))
+                    {
+                    }
+                    return;
+                }
+            }
+            std::this_thread::yield();
+        }
+    }
+
+    void LogDispatcher::flush()
+    {
+        if (InConsumer())
+        {
+            return;
+        }
+
+        std::vector<std::shared_ptr<Ring> > rings;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            rings = m_rings;
+            m_cond.notify_one();
+        }
+
+        for (auto &i : rings)
+        {
+            uint64_t head = i->head();
+            while (i->tail() < head && m_running.load(std::memory_order_relaxed))
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+    }
+
+    void LogDispatcher::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (!m_running.load())
+            {
+                return;
+            }
+            m_running.store(false);
+            m_cond.notify_one();
+        }
+        m_thread.join();
+
+        std::vector<std::shared_ptr<Ring> > rings;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            rings.swap(m_rings);
+            for (auto &i : rings)
+            {
+                i->detach();
+            }
+        }
+
+        // 消费线程最后一轮之后才入队的事件在这里输出，之后入队的由生产线程自己输出
+        // 与post()入队后的栅栏配对: 生产者若仍看到m_running为true，这里一定能看到它入队的事件
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::lock_guard<std::mutex> lock(m_drainMutex);
+        for (auto &i : rings)
+        {
+            while (i->consume([](Ring::Record &r) {
+                r.logger->callAppenders(r.level, r.event);
+            }, 256))
+            {
+            }
+        }
+        m_stopped = true;
+    }
+
+    size_t LogDispatcher::getRingCount()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_rings.size();
+    }
+
+    void LogDispatcher::setOverflowPolicy(const LogOverflowPolicy &val)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_policy = val;
+    }
+
+    LogOverflowPolicy LogDispatcher::getOverflowPolicy()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_policy;
+    }
+
+    void LogDispatcher::reportDropped(const std::shared_ptr<Logger> &logger)
+    {
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (TENSIR_LIKELY(dropped == m_reported))
+        {
+            return;
+        }
+        uint64_t now = GetCurrentNS();
+        if (now < m_nextReport)
+        {
+            return;
+        }
+        logger->callAppenders(LogLevel::WARN, CreateDroppedEvent(logger, dropped - m_reported));
+        m_reported = dropped;
+        m_nextReport = now + kDropReportInterval;
+    }
+
+    size_t LogDispatcher::drain(std::vector<std::shared_ptr<Ring> > &rings)
+    {
+        size_t total = 0;
+        bool has_closed = false;
+        for (auto &i : rings)
+        {
+            // 每个队列一次最多取一批，避免某个线程独占消费线程
+            total += i->consume([this](Ring::Record &r) {
+                reportDropped(r.logger);
+                r.logger->callAppenders(r.level, r.event);
+            }, 256);
+            if (i->isClosed() && i->empty())
+            {
+                has_closed = true;
+            }
+        }
+
+        if (has_closed)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (auto it = m_rings.begin(); it != m_rings.end();)
+            {
+                if ((*it)->isClosed() && (*it)->empty())
+                {
+                    it = m_rings.erase(it);
+                }
+                else
+                {
+                    ++it;
+                }
+            }
+            m_version.fetch_add(1, std::memory_order_release);
+        }
+        return total;
+    }
+
+    void LogDispatcher::consume()
+    {
+        t_inConsumer = true;
+        std::vector<std::shared_ptr<Ring> > rings;
+        uint64_t version = ~0ull;
+        int idle = 0;
+        while (true)
+        {
+            if (m_version.load(std::memory_order_acquire) != version)
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                rings = m_rings;
+                version = m_version.load(std::memory_order_relaxed);
+            }
+
+            if (drain(rings))
+            {
+                idle = 0;
+                continue;
+            }
+
+            if (!m_running.load(std::memory_order_acquire))
+            {
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    rings = m_rings;
+                }
+                while (drain(rings))
+                {
+                }
+                break;
+            }
+
+            // 先自旋一会儿，仍然没有数据再休眠
+            if (++idle < 64)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_sleeping.store(true, std::memory_order_seq_cst);
+            bool empty = true;
+            for (auto &i : rings)
+            {
+                if (!i->empty())
+                {
+                    empty = false;
+                    break;
+                }
+            }
+            if (empty && m_running.load() && m_version.load() == version)
+            {
+                m_cond.wait_for(lock, std::chrono::milliseconds(10));
+            }
+            m_sleeping.store(false, std::memory_order_relaxed);
+            idle = 0;
+        }
+        t_inConsumer = false;
+    }
+
+    namespace
+    {
+        /**
+         * @brief 各日志级别上的日志器个数，用于维护Logger::s_levelFloor
+         */
+        struct LevelCounts
+        {
+            std::mutex mutex;
+            int counts[LogLevel::FATAL + 1] = {0};
+        };
+
+        LevelCounts &GetLevelCounts()
+        {
+            static LevelCounts s_counts;
+            return s_counts;
+        }
+    }
+
+    /// 没有日志器时所有级别都不输出
+    std::atomic<int> Logger::s_levelFloor(LogLevel::FATAL + 1);
+
+    /**
+     * @brief 日志器级别从from变为to，from/to为-1表示创建/销毁
+     */
+    static void UpdateLevelFloor(std::atomic<int> &floor, int from, int to)
+    {
+        LevelCounts &lc = GetLevelCounts();
+        std::lock_guard<std::mutex> lock(lc.mutex);
+        if (from >= 0)
+        {
+            --lc.counts[from];
+        }
+        if (to >= 0)
+        {
+            ++lc.counts[to];
+        }
+        int level = 0;
+        while (level <= LogLevel::FATAL && lc.counts[level] == 0)
+        {
+            ++level;
+        }
+        floor.store(level, std::memory_order_relaxed);
+    }
+
+    Logger::Logger(const std::string &name)
+        : m_name(name),
+          m_level(LogLevel::DEBUG), // 默认日志级别为DEBUG
+          m_effectiveLevel(LogLevel::DEBUG),
+          m_config(new Config)
+    {
+        m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+        UpdateLevelFloor(s_levelFloor, -1, m_effectiveLevel);
+    }
+
+    Logger::~Logger()
+    {
+        {
+            MutexType::Lock lock(HierarchyMutex());
+            const Config *config = m_config.get();
+            if (config->parent)
+            {
+                std::vector<Logger *> &siblings = config->parent->m_children;
+                siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+            }
+        }
+        UpdateLevelFloor(s_levelFloor, m_effectiveLevel.load(), -1);
+
+        if (LogDispatcher::InConsumer())
+        {
+            // 队列中最后一条日志持有最后一个引用时，日志器在消费线程中析构。分发器的析构函数要等待的
+            // 正是当前线程，不能在这里释放，交给一个临时线程释放
+            std::unique_ptr<Config> config(m_config.exchange(nullptr));
+            if (config->dispatcher || config->effectiveDispatcher)
+            {
+                std::thread([](LogDispatcher::ptr, LogDispatcher::ptr) {},
+                            std::move(config->dispatcher), std::move(config->effectiveDispatcher)).detach();
+            }
+        }
+    }
+
+    Logger::MutexType &Logger::HierarchyMutex()
+    {
+        static MutexType s_mutex;
+        return s_mutex;
+    }
+
+    void Logger::publish(Config *config, Garbage &garbage)
+    {
+        const Logger *parent = config->parent.get();
+        const Config *inherited = parent ? parent->m_config.get() : nullptr;
+        if (config->appenders.empty() && inherited)
+        {
+            config->effectiveAppenders = inherited->effectiveAppenders;
+        }
+        else
+        {
+            config->effectiveAppenders = std::make_shared<const std::vector<LogAppender::ptr>>(config->appenders);
+        }
+        config->effectiveDispatcher = !config->dispatcher && inherited ? inherited->effectiveDispatcher : config->dispatcher;
+
+        int level = m_level.load(std::memory_order_relaxed);
+        if (level == LogLevel::UNKNOWN && parent)
+        {
+            level = parent->m_effectiveLevel.load(std::memory_order_relaxed);
+        }
+        int old = m_effectiveLevel.exchange(level);
+        if (old != level)
+        {
+            UpdateLevelFloor(s_levelFloor, old, level);
+        }
+
+        garbage.emplace_back(m_config.exchange(config));
+        for (Logger *child : m_children)
+        {
+            child->publish(new Config(*child->m_config.get()), garbage);
+        }
+    }
+
+    void Logger::setLevel(LogLevel::Level val)
+    {
+        if (val < LogLevel::UNKNOWN || val > LogLevel::FATAL)
+        {
+            return;
+        }
+        updateConfig([this, val](Config &) { m_level.store(val, std::memory_order_relaxed); });
+    }
+
+    void Logger::setFormatter(LogFormatter::ptr val)
+    {
+        MutexType::Lock lock(HierarchyMutex());
+        m_formatter = val;
+
+        for (auto &i : m_config.get()->appenders)
+        {
+            LogAppender::MutexType::Lock ll(i->m_mutex);
+            if (!i->m_hasFormatter) // 没有设置日志格式器的跟随日志器的格式器
+            {
+                i->m_formatter = m_formatter;
+            }
+        }
+    }
+
+    void Logger::setFormatter(const std::string &val)
+    {
+        LogFormatter::ptr new_val(new LogFormatter(val));
+        if (new_val->isError())
+        {
+            std::cout << "Logger setFormatter name=" << m_name
+                      << " value=" << val << " invalid formatter"
+                      << std::endl;
+            return;
+        }
+        setFormatter(new_val);
+    }
+
+    LogFormatter::ptr Logger::getFormatter()
+    {
+        MutexType::Lock lock(HierarchyMutex());
+        return m_formatter;
+    }
+
+    std::string Logger::toYamlString()
+    {
+        // MutexType::Lock lock(m_mutex);
+        // YAML::Node node;
+        // node["name"] = m_name;
+        // if (m_level != LogLevel::UNKNOW)
+        // {
+        //     node["level"] = LogLevel::ToString(m_level);
+        // }
+        // if (m_formatter)
+        // {
+        //     node["formatter"] = m_formatter->getPattern();
+        // }
+
+        // for (auto &i : m_appenders)
+        // {
+        //     node["appenders"].push_back(YAML::Load(i->toYamlString()));
+        // }
+        // std::stringstream ss;
+        // ss << node;
+        // return ss.str();
+        return "";
+    }
+
+    void Logger::addAppender(LogAppender::ptr appender)
+    {
+        updateConfig([this, &appender](Config &config) {
+            {
+                LogAppender::MutexType::Lock ll(appender->m_mutex);
+                // 不经过setFormatter，之后修改日志器的格式器仍会同步到该Appender
+                if (!appender->m_formatter)
+                {
+                    appender->m_formatter = m_formatter;
+                }
+            }
+            config.appenders.push_back(appender);
+        });
+    }
+
+    void Logger::delAppender(LogAppender::ptr appender)
+    {
+        updateConfig([&appender](Config &config) {
+            auto it = std::find(config.appenders.begin(), config.appenders.end(), appender);
+            if (it != config.appenders.end())
+            {
+                config.appenders.erase(it);
+            }
+        });
+    }
+
+    void Logger::clearAppenders()
+    {
+        updateConfig([](Config &config) { config.appenders.clear(); });
+    }
+
+    std::vector<LogAppender::ptr> Logger::getAppenders() const
+    {
+        RcuPtr<Config>::ReadGuard config(m_config);
+        return config->appenders;
+    }
+
+    void Logger::setParent(Logger::ptr parent)
+    {
+        Garbage garbage;
+        MutexType::Lock lock(HierarchyMutex());
+        for (Logger *p = parent.get(); p; p = p->m_config.get()->parent.get())
+        {
+            if (p == this)
+            {
+                return;
+            }
+        }
+
+        Config *config = new Config(*m_config.get());
+        if (config->parent)
+        {
+            std::vector<Logger *> &siblings = config->parent->m_children;
+            siblings.erase(std::remove(siblings.begin(), siblings.end(), this), siblings.end());
+        }
+        config->parent = parent;
+        if (parent)
+        {
+            parent->m_children.push_back(this);
+        }
+        publish(config, garbage);
+    }
+
+    Logger::ptr Logger::getParent() const
+    {
+        RcuPtr<Config>::ReadGuard config(m_config);
+        return config->parent;
+    }
+
+    void Logger::setDispatcher(LogDispatcher::ptr val)
+    {
+        updateConfig([&val](Config &config) { config.dispatcher = val; });
+    }
+
+    LogDispatcher::ptr Logger::getDispatcher() const
+    {
+        RcuPtr<Config>::ReadGuard config(m_config);
+        return config->dispatcher;
+    }
+
+    void Logger::log(LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level < getLevel())
+        {
+            m_metrics.addFiltered();
+        }
+        else
+        {
+            m_metrics.addAccepted();
+            AppenderList appenders;
+            LogDispatcher::ptr dispatcher;
+            snapshot(appenders, &dispatcher);
+            // 消费线程上直接输出，避免向自己的队列投递造成死等
+            if (dispatcher && !LogDispatcher::InConsumer() && dispatcher->post(shared_from_this(), level, event))
+            {
+                return;
+            }
+            callAppenders(level, event, appenders);
+        }
+    }
+
+    void Logger::callAppenders(LogLevel::Level level, LogEvent::ptr event)
+    {
+        AppenderList appenders;
+        snapshot(appenders, nullptr);
+        callAppenders(level, event, appenders);
+    }
+
+    void Logger::snapshot(AppenderList &appenders, LogDispatcher::ptr *dispatcher) const
+    {
+        // 读临界区只覆盖引用计数的复制，Appender阻塞时不会拖住修改配置的线程
+        RcuPtr<Config>::ReadGuard config(m_config);
+        appenders = config->effectiveAppenders;
+        if (dispatcher)
+        {
+            *dispatcher = config->effectiveDispatcher;
+        }
+    }
+
+    void Logger::callAppenders(LogLevel::Level level, const LogEvent::ptr &event, const AppenderList &appenders)
+    {
+        if (appenders && !appenders->empty())
+        {
+            auto self = shared_from_this();
+            bool timing = LogMetrics::ShouldTime();
+            t_callTiming = timing;
+            uint64_t format_time = 0;
+            uint64_t write_time = 0;
+            uint64_t bytes = 0;
+            for (auto &i : *appenders)
+            {
+                if (level < i->getLevel())
+                {
+                    i->m_metrics.addFiltered();
+                    continue;
+                }
+                i->m_metrics.addAccepted();
+                // 日志目标内部的formatEvent把格式化耗时和字节数记在线程局部变量上，总耗时减去格式化即为写入耗时
+                t_callFormatTime = 0;
+                t_callBytes = 0;
+                uint64_t begin = timing ? LogMetrics::Now() : 0;
+                i->log(self, level, event);
+                if (timing)
+                {
+                    uint64_t total = LogMetrics::Now() - begin;
+                    uint64_t write = total > t_callFormatTime ? total - t_callFormatTime : 0;
+                    i->m_metrics.addWriteTime(write);
+                    format_time += t_callFormatTime;
+                    write_time += write;
+                }
+                bytes += t_callBytes;
+            }
+            t_callTiming = false;
+            if (timing)
+            {
+                m_metrics.addFormatTime(format_time);
+                m_metrics.addWriteTime(write_time);
+            }
+            m_metrics.addBytes(bytes);
+        }
+    }
+
+    void Logger::debug(LogEvent::ptr event)
+    {
+        log(LogLevel::DEBUG, event);
+    }
+
+    void Logger::info(LogEvent::ptr event)
+    {
+        log(LogLevel::INFO, event);
+    }
+
+    void Logger::warn(LogEvent::ptr event)
+    {
+        log(LogLevel::WARN, event);
+    }
+
+    void Logger::error(LogEvent::ptr event)
+    {
+        log(LogLevel::ERROR, event);
+    }
+
+    void Logger::fatal(LogEvent::ptr event)
+    {
+        log(LogLevel::FATAL, event);
+    }
+
+    void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level >= getLevel())
+        {
+            std::string fallback;
+            std::string &buf = GetFormatBuffer(fallback);
+            buf.clear();
+            MutexType::Lock lock(m_mutex);
+            formatEvent(*m_formatter, buf, logger.get(), level, *event);
+            std::cout.write(buf.data(), buf.size());
+        }
+    }
+
+    std::string StdoutLogAppender::toYamlString()
+    {
+        // MutexType::Lock lock(m_mutex);
+        // YAML::Node node;
+        // node["type"] = "StdoutLogAppender";
+        // if (m_level != LogLevel::UNKNOW)
+        // {
+        //     node["level"] = LogLevel::ToString(m_level);
+        // }
+        // if (m_hasFormatter && m_formatter)
+        // {
+        //     node["formatter"] = m_formatter->getPattern();
+        // }
+        // std::stringstream ss;
+        // ss << node;
+        // return ss.str();
+        return "";
+    }
+
+    void StdoutLogAppender::append(const char *data, size_t len)
+    {
+        addWritten(len);
+        MutexType::Lock lock(m_mutex);
+        std::cout.write(data, len);
+    }
+
+    void StdoutLogAppender::flush()
+    {
+        MutexType::Lock lock(m_mutex);
+        std::cout.flush();
+    }
+
+    namespace
+    {
+        /**
+         * @brief 写出一组数据，socket不等待也不产生SIGPIPE
+         * @return 写入的字节数，出错返回-1
+         */
+        ssize_t WriteIov(int fd, bool socket, struct iovec *iov, int count)
+        {
+            if (socket)
+            {
+                struct msghdr msg;
+                memset(&msg, 0, sizeof(msg));
+                msg.msg_iov = iov;
+                msg.msg_iovlen = count;
+                return sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+            }
+            return writev(fd, iov, count);
+        }
+    }
+
+    ConsoleLogAppender::ConsoleLogAppender(int fd, bool nonblock, size_t max_pending)
+        : m_fd(fd),
+          m_maxPending(std::max<size_t>(max_pending, 4096))
+    {
+        struct stat st;
+        if (!nonblock || fstat(fd, &st) != 0)
+        {
+            return;
+        }
+        if (S_ISFIFO(st.st_mode))
+        {
+            // 管道的文件状态与父进程等共享，重新打开得到私有的文件描述后再设置O_NONBLOCK
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+            int private_fd = ::open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+            if (private_fd >= 0)
+            {
+                m_fd = private_fd;
+                m_ownFd = true;
+                m_nonblock = true;
+            }
+        }
+        else if (S_ISSOCK(st.st_mode))
+        {
+            m_socket = true;
+            m_nonblock = true;
+        }
+    }
+
+    ConsoleLogAppender::~ConsoleLogAppender()
+    {
+        MutexType::Lock lock(m_mutex);
+        drain(lock);
+        // 非阻塞模式下最多再等1秒
+        for (int i = 0; i < 10 && m_batchPos < m_batch.size(); ++i)
+        {
+            struct pollfd pfd;
+            pfd.fd = m_fd;
+            pfd.events = POLLOUT;
+            if (poll(&pfd, 1, 100) < 0 && errno != EINTR)
+            {
+                break;
+            }
+            drain(lock);
+        }
+        if (m_ownFd)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    void ConsoleLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level >= getLevel())
+        {
+            MutexType::Lock lock(m_mutex);
+            if (!reserve(lock, 0))
+            {
+                ++m_dropped;
+                m_metrics.addDropped();
+                return;
+            }
+            formatEvent(*m_formatter, m_pending, logger.get(), level, *event);
+            drain(lock);
+        }
+    }
+
+    std::string ConsoleLogAppender::toYamlString()
+    {
+        // YAML::Node node;
+        // node["type"] = "ConsoleLogAppender";
+        // node["fd"] = m_fd;
+        return "";
+    }
+
+    void ConsoleLogAppender::append(const char *data, size_t len)
+    {
+        MutexType::Lock lock(m_mutex);
+        if (!reserve(lock, len))
+        {
+            uint64_t lines = std::count(data, data + len, '\n');
+            m_dropped += lines;
+            m_metrics.addDropped(lines);
+            return;
+        }
+        addWritten(len);
+        m_pending.append(data, len);
+        drain(lock);
+    }
+
+    void ConsoleLogAppender::flush()
+    {
+        MutexType::Lock lock(m_mutex);
+        while (!m_nonblock && m_draining)
+        {
+            m_cond.wait(lock);
+        }
+        drain(lock);
+    }
+
+    uint64_t ConsoleLogAppender::getDroppedCount()
+    {
+        MutexType::Lock lock(m_mutex);
+        return m_dropped;
+    }
+
+    bool ConsoleLogAppender::reserve(MutexType::Lock &lock, size_t len)
+    {
+        while (!m_pending.empty() && m_pending.size() + len > m_maxPending)
+        {
+            if (!m_draining)
+            {
+                drain(lock);
+                if (m_nonblock && !m_pending.empty() && m_pending.size() + len > m_maxPending)
+                {
+                    return false;
+                }
+            }
+            else if (m_nonblock)
+            {
+                return false;
             }
             else
             {
-                auto it = s_format_items.find(std::get<0>(i));
-                if (it == s_format_items.end())
+                m_cond.wait(lock);
+            }
+        }
+        return true;
+    }
+
+    void ConsoleLogAppender::drain(MutexType::Lock &lock)
+    {
+        if (m_draining)
+        {
+            return;
+        }
+        m_draining = true;
+        while (true)
+        {
+            if (m_batchPos == m_batch.size())
+            {
+                // 上一批写完后才取新的一批，丢弃提示放在两批之间
+                if (m_dropped != m_reported)
+                {
+                    m_note = "[tensir] " + std::to_string(m_dropped - m_reported) + " log messages dropped\n";
+                    m_notePos = 0;
+                    m_reported = m_dropped;
+                }
+                m_batch.clear();
+                m_batchPos = 0;
+                m_batch.swap(m_pending);
+                m_cond.notify_all();
+            }
+            if (m_notePos == m_note.size() && m_batchPos == m_batch.size())
+            {
+                break;
+            }
+
+            struct iovec iov[2];
+            int count = 0;
+            if (m_notePos < m_note.size())
+            {
+                iov[count].iov_base = &m_note[m_notePos];
+                iov[count++].iov_len = m_note.size() - m_notePos;
+            }
+            if (m_batchPos < m_batch.size())
+            {
+                iov[count].iov_base = &m_batch[m_batchPos];
+                iov[count++].iov_len = m_batch.size() - m_batchPos;
+            }
+            lock.unlock();
+            ssize_t n = WriteIov(m_fd, m_socket, iov, count);
+            int err = errno;
+            lock.lock();
+
+            if (n < 0)
+            {
+                if (err == EINTR)
+                {
+                    continue;
+                }
+                if (err == EAGAIN || err == EWOULDBLOCK)
+                {
+                    // 留到下一次写日志或flush时再试
+                    break;
+                }
+                // 输出已经关闭，丢弃这一批
+                n = (m_note.size() - m_notePos) + (m_batch.size() - m_batchPos);
+            }
+            size_t note = std::min<size_t>(n, m_note.size() - m_notePos);
+            m_notePos += note;
+            m_batchPos += n - note;
+        }
+        m_draining = false;
+        m_cond.notify_all();
+    }
+
+    namespace
+    {
+        /**
+         * @brief 写入全部数据
+         * @return 写入的字节数，出错时少于len
+         */
+        size_t WriteAll(int fd, const char *data, size_t len)
+        {
+            size_t done = 0;
+            while (done < len)
+            {
+                ssize_t n = ::write(fd, data + done, len - done);
+                if (n < 0)
+                {
+                    if (errno == EINTR)
+                    {
+                        continue;
+                    }
+                    break;
+                }
+                done += n;
+            }
+            return done;
+        }
+
+        /**
+         * @brief 关闭文件，trim为true时先释放fallocate预留但没有用到的空间
+         * @details 不滚动的文件可能被其他进程同时追加，不能截断
+         */
+        void CloseFile(int fd, bool trim)
+        {
+            struct stat st;
+            if (trim && fstat(fd, &st) == 0)
+            {
+                // 释放失败只是多占一些磁盘空间
+                int ret = ftruncate(fd, st.st_size);
+                (void)ret;
+            }
+            ::close(fd);
+        }
+
+        /**
+         * @brief 列出filename.N形式的滚动文件序号
+         */
+        std::vector<uint64_t> ListSegments(const std::string &filename)
+        {
+            std::vector<uint64_t> indexes;
+            size_t slash = filename.rfind('/');
+            std::string dir = slash == std::string::npos ? "." : filename.substr(0, slash + 1);
+            std::string prefix = (slash == std::string::npos ? filename : filename.substr(slash + 1)) + ".";
+
+            DIR *d = opendir(dir.c_str());
+            if (!d)
+            {
+                return indexes;
+            }
+            while (struct dirent *ent = readdir(d))
+            {
+                const char *name = ent->d_name;
+                if (strncmp(name, prefix.c_str(), prefix.size()) != 0)
+                {
+                    continue;
+                }
+                const char *p = name + prefix.size();
+                char *end = nullptr;
+                unsigned long long index = strtoull(p, &end, 10);
+                if (*p >= '0' && *p <= '9' && *end == '\0')
+                {
+                    indexes.push_back(index);
+                }
+            }
+            closedir(d);
+            std::sort(indexes.begin(), indexes.end());
+            return indexes;
+        }
+    }
+
+    FileLogAppender::FileLogAppender(const std::string &filename, uint64_t max_size, uint32_t interval, uint32_t max_files)
+        : m_filename(filename),
+          m_maxSize(max_size),
+          m_interval(interval),
+          m_maxFiles(max_files)
+    {
+        m_buffer.reserve(kBufferSize);
+        if (isRolling())
+        {
+            // 接着已有的最大序号写新文件
+            std::vector<uint64_t> indexes = ListSegments(m_filename);
+            m_index = indexes.empty() ? 1 : indexes.back() + 1;
+            m_fd = openSegment(m_index);
+            m_rollTime = nextRollTime(time(0));
+        }
+        else
+        {
+            reopen();
+        }
+        m_task = LogWorker::Instance().schedule(1000, std::bind(&FileLogAppender::maintain, this));
+        if (isRolling())
+        {
+            LogWorker::Instance().trigger(m_task);
+        }
+    }
+
+    FileLogAppender::~FileLogAppender()
+    {
+        LogWorker::Instance().cancel(m_task);
+        if (m_syncTask)
+        {
+            LogWorker::Instance().cancel(m_syncTask);
+        }
+        writeBuffer(m_buffer.size());
+        if (m_fd >= 0)
+        {
+            if (m_durability != NONE)
+            {
+                fdatasync(m_fd);
+            }
+            CloseFile(m_fd, isRolling());
+        }
+        for (int fd : m_retired)
+        {
+            CloseFile(fd, isRolling());
+        }
+        if (m_nextFd >= 0)
+        {
+            ::close(m_nextFd);
+            unlink(segmentPath(m_index + 1).c_str());
+        }
+        if (m_maxFiles && m_index != m_cleanedIndex)
+        {
+            removeOldSegments(m_index);
+        }
+    }
+
+    void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level >= getLevel())
+        {
+            uint64_t now = event->getTime();
+            MutexType::Lock lock(m_mutex);
+            size_t pos = m_buffer.size();
+            formatEvent(*m_formatter, m_buffer, logger.get(), level, *event);
+            if (now >= m_rollTime || isFull(m_size + pos, m_buffer.size() - pos))
+            {
+                // 之前的日志留在旧文件，这一条写入新文件
+                writeBuffer(pos);
+                roll(now);
+            }
+            if (m_durability == GROUP_COMMIT && level >= m_syncLevel)
+            {
+                commit(lock, m_written + m_buffer.size());
+            }
+            else if (m_buffer.size() >= kBufferSize)
+            {
+                writeBuffer(m_buffer.size());
+            }
+        }
+    }
+
+    std::string FileLogAppender::toYamlString()
+    {
+        // MutexType::Lock lock(m_mutex);
+        // YAML::Node node;
+        // node["type"] = "FileLogAppender";
+        // node["file"] = m_filename;
+        // ...
+        return "";
+    }
+
+    bool FileLogAppender::reopen()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (isRolling())
+        {
+            writeBuffer(m_buffer.size());
+            return roll(time(0));
+        }
+
+        int fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            return false;
+        }
+        writeBuffer(m_buffer.size());
+        if (m_fd >= 0)
+        {
+            if (m_durability != NONE)
+            {
+                fdatasync(m_fd);
+                m_synced = m_written;
+            }
+            m_retired.push_back(m_fd);
+        }
+        m_fd = fd;
+        return true;
+    }
+
+    std::string FileLogAppender::getCurrentFile()
+    {
+        MutexType::Lock lock(m_mutex);
+        return isRolling() ? segmentPath(m_index) : m_filename;
+    }
+
+    void FileLogAppender::append(const char *data, size_t len)
+    {
+        addWritten(len);
+        uint64_t now = time(0);
+        MutexType::Lock lock(m_mutex);
+        if (now >= m_rollTime)
+        {
+            writeBuffer(m_buffer.size());
+            roll(now);
+        }
+        while (len)
+        {
+            size_t n = len;
+            uint64_t used = m_size + m_buffer.size();
+            if (isFull(used, len))
+            {
+                // 在放得下的最后一个完整行之后切开，一行都放不下时切换文件，新文件也放不下时整行写入
+                const char *end = m_maxSize > used ? (const char *)memrchr(data, '\n', std::min<uint64_t>(len, m_maxSize - used)) : nullptr;
+                if (end)
                 {
-                    m_items.push_back(FormatItem::ptr(new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")));
-                    m_error = true;
+                    n = end - data + 1;
                 }
                 else
                 {
-                    m_items.push_back(it->second(std::get<1>(i)));
+                    writeBuffer(m_buffer.size());
+                    if (roll(now))
+                    {
+                        continue;
+                    }
+                }
+            }
+            else if (m_maxSize && !used && len > m_maxSize)
+            {
+                const char *end = (const char *)memchr(data, '\n', len);
+                n = end ? end - data + 1 : len;
+            }
+            m_buffer.append(data, n);
+            data += n;
+            len -= n;
+            if (m_buffer.size() >= kBufferSize)
+            {
+                writeBuffer(m_buffer.size());
+            }
+        }
+    }
+
+    void FileLogAppender::flush()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_durability == GROUP_COMMIT)
+        {
+            // 作为AsyncLogAppender的目标时，每批数据写出后一起落盘
+            commit(lock, m_written + m_buffer.size());
+            return;
+        }
+        writeBuffer(m_buffer.size());
+    }
+
+    void FileLogAppender::setDurability(Durability mode, uint32_t interval, LogLevel::Level level)
+    {
+        if (mode == PERIODIC && !interval)
+        {
+            // 间隔为0时后台任务永远不会落盘，改为每条日志都等待落盘
+            mode = GROUP_COMMIT;
+            level = LogLevel::DEBUG;
+        }
+        uint64_t task;
+        {
+            MutexType::Lock lock(m_mutex);
+            m_durability = mode;
+            m_syncLevel = level;
+            task = m_syncTask;
+            m_syncTask = 0;
+        }
+        // 任务中会加锁，不能持锁取消
+        if (task)
+        {
+            LogWorker::Instance().cancel(task);
+        }
+        if (mode != NONE && interval)
+        {
+            task = LogWorker::Instance().schedule(interval, std::bind(&FileLogAppender::periodicSync, this));
+            MutexType::Lock lock(m_mutex);
+            m_syncTask = task;
+        }
+    }
+
+    FileLogAppender::Durability FileLogAppender::getDurability()
+    {
+        MutexType::Lock lock(m_mutex);
+        return m_durability;
+    }
+
+    void FileLogAppender::sync()
+    {
+        MutexType::Lock lock(m_mutex);
+        commit(lock, m_written + m_buffer.size());
+    }
+
+    void FileLogAppender::commit(MutexType::Lock &lock, uint64_t target)
+    {
+        while (m_synced < target)
+        {
+            if (m_syncing)
+            {
+                m_syncCond.wait(lock);
+                continue;
+            }
+            // 等待期间其他线程写入的日志也由这一次fdatasync覆盖
+            writeBuffer(m_buffer.size());
+            int fd = m_fd;
+            uint64_t written = m_written;
+            m_syncing = true;
+            lock.unlock();
+            if (fd >= 0)
+            {
+                fdatasync(fd);
+            }
+            lock.lock();
+            m_synced = std::max(m_synced, written);
+            m_syncing = false;
+            m_syncCond.notify_all();
+        }
+    }
+
+    void FileLogAppender::periodicSync()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (!m_syncing)
+        {
+            commit(lock, m_written + m_buffer.size());
+        }
+    }
+
+    std::string FileLogAppender::segmentPath(uint64_t index) const
+    {
+        return m_filename + "." + std::to_string(index);
+    }
+
+    int FileLogAppender::openSegment(uint64_t index) const
+    {
+        int fd = ::open(segmentPath(index).c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd >= 0)
+        {
+            // 只预留空间不改变文件大小，不支持时退化为普通写入
+            int ret = fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, m_maxSize ? m_maxSize : kPreallocSize);
+            (void)ret;
+        }
+        return fd;
+    }
+
+    uint64_t FileLogAppender::nextRollTime(uint64_t now) const
+    {
+        if (!m_interval)
+        {
+            return UINT64_MAX;
+        }
+        // 按本地时间对齐，如interval为86400时在本地零点滚动
+        struct tm tm;
+        time_t t = now;
+        localtime_r(&t, &tm);
+        int64_t local = (int64_t)now + tm.tm_gmtoff;
+        return now + (m_interval - (uint64_t)local % m_interval);
+    }
+
+    bool FileLogAppender::isFull(uint64_t used, size_t len) const
+    {
+        // 空文件总是写得下，避免单条日志超过大小时不停切换
+        return m_maxSize && used && used + len > m_maxSize;
+    }
+
+    bool FileLogAppender::roll(uint64_t now)
+    {
+        m_rollTime = nextRollTime(now);
+        LogWorker::Instance().trigger(m_task);
+
+        int fd = m_nextFd;
+        m_nextFd = -1;
+        if (fd < 0)
+        {
+            // 后台线程还没准备好，只能同步打开
+            fd = openSegment(m_index + 1);
+            if (fd < 0)
+            {
+                return false;
+            }
+        }
+        if (m_fd >= 0)
+        {
+            if (m_durability != NONE)
+            {
+                // 之后的fdatasync只覆盖新文件，旧文件在这里落盘
+                fdatasync(m_fd);
+                m_synced = m_written;
+            }
+            m_retired.push_back(m_fd);
+        }
+        m_fd = fd;
+        ++m_index;
+        m_size = 0;
+        return true;
+    }
+
+    void FileLogAppender::writeBuffer(size_t len)
+    {
+        if (!len)
+        {
+            return;
+        }
+        if (m_fd >= 0)
+        {
+            m_size += WriteAll(m_fd, m_buffer.data(), len);
+        }
+        // 写失败的数据也计入，避免等待落盘的线程一直等下去
+        m_written += len;
+        m_buffer.erase(0, len);
+    }
+
+    void FileLogAppender::maintain()
+    {
+        std::vector<int> retired;
+        uint64_t index;
+        bool prepare;
+        {
+            MutexType::Lock lock(m_mutex);
+            writeBuffer(m_buffer.size());
+            // 正在fdatasync的文件可能已经被换下，等它完成后再关闭
+            while (m_syncing)
+            {
+                m_syncCond.wait(lock);
+            }
+            retired.swap(m_retired);
+            index = m_index;
+            prepare = isRolling() && m_nextFd < 0;
+        }
+
+        for (int fd : retired)
+        {
+            CloseFile(fd, isRolling());
+        }
+
+        if (!isRolling())
+        {
+            // 文件被移走或删除时重新打开
+            struct stat path_st, fd_st;
+            int fd;
+            {
+                MutexType::Lock lock(m_mutex);
+                fd = m_fd;
+            }
+            if (fd < 0 || stat(m_filename.c_str(), &path_st) != 0 ||
+                (fstat(fd, &fd_st) == 0 && (path_st.st_dev != fd_st.st_dev || path_st.st_ino != fd_st.st_ino)))
+            {
+                reopen();
+            }
+            return;
+        }
+
+        if (prepare)
+        {
+            int fd = openSegment(index + 1);
+            if (fd >= 0)
+            {
+                MutexType::Lock lock(m_mutex);
+                if (m_nextFd < 0 && m_index == index)
+                {
+                    m_nextFd = fd;
+                    fd = -1;
                 }
             }
+            if (fd >= 0)
+            {
+                // 期间已经同步切换过，这个文件可能正被使用，只关闭不删除
+                ::close(fd);
+            }
+        }
+
+        if (m_maxFiles && index != m_cleanedIndex)
+        {
+            removeOldSegments(index);
+            m_cleanedIndex = index;
+        }
+    }
+
+    void FileLogAppender::removeOldSegments(uint64_t current)
+    {
+        std::vector<uint64_t> indexes = ListSegments(m_filename);
+        for (uint64_t index : indexes)
+        {
+            if (index + m_maxFiles <= current)
+            {
+                unlink(segmentPath(index).c_str());
+            }
+        }
+    }
 
-            //std::cout << "(" << std::get<0>(i) << ") - (" << std::get<1>(i) << ") - (" << std::get<2>(i) << ")" << std::endl;
+    AsyncLogAppender::AsyncLogAppender(LogAppender::ptr target, uint32_t flush_interval, size_t buffer_size, size_t max_buffers)
+        : m_target(target),
+          m_flushInterval(flush_interval),
+          m_bufferSize(buffer_size),
+          m_queueDepth(0),
+          m_maxBuffers(max_buffers),
+          m_dropped(0)
+    {
+        if (!target || !target->supportsAppend())
+        {
+            throw std::invalid_argument("AsyncLogAppender target must support append()");
         }
+        m_current = takeBuffer();
+        m_spares.push_back(takeBuffer());
+        m_running = true;
+        m_thread = std::thread(&AsyncLogAppender::backend, this);
     }
 
-    void LogAppender::setFormatter(LogFormatter::ptr val)
+    AsyncLogAppender::~AsyncLogAppender()
     {
-        // MutexType::Lock lock(m_mutex);
-        m_formatter = val;
-        if (m_formatter)
+        stop();
+    }
+
+    void AsyncLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level < getLevel())
         {
-            m_hasFormatter = true;
+            return;
+        }
+        // 格式化在锁外完成，临界区内只做一次拷贝；延迟格式化的事件只拷贝参数，交给后台线程渲染
+        std::string fallback;
+        std::string &msg = GetFormatBuffer(fallback);
+        msg.clear();
+        size_t len;
+        if (event->isDeferred())
+        {
+            len = event->getSS().size() + event->getFields().size() + sizeof(Deferred);
         }
         else
         {
-            m_hasFormatter = false;
+            formatEvent(*getFormatter(), msg, logger.get(), level, *event);
+            len = msg.size();
+        }
+
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        if (!reserve(lock, logger, level, len))
+        {
+            if (m_running)
+            {
+                return;
+            }
+            // 已经停止，后台线程不再消费缓冲，直接写入目标Appender
+            lock.unlock();
+            if (event->isDeferred())
+            {
+                formatEvent(*getFormatter(), msg, logger.get(), level, *event);
+            }
+            m_target->append(msg.data(), msg.size());
+            return;
+        }
+        if (!event->isDeferred())
+        {
+            m_current->data.append(msg);
+            return;
         }
+        Chunk &chunk = *m_current;
+        const LogStream &args = event->getSS();
+        const std::string &fields = event->getFields();
+        Deferred deferred = {chunk.data.size(), logger, level, event->getFilename(), event->getLine(),
+                             event->getElapse(), event->getThreadId(), event->getFiberId(), event->getStamp(),
+                             event->getThreadName(), event->getDeferFormat(), chunk.args.size(), args.size(), fields.size()};
+        chunk.args.append(args.data(), args.size());
+        chunk.args.append(fields);
+        chunk.deferred.push_back(std::move(deferred));
     }
 
-    LogFormatter::ptr LogAppender::getFormatter()
+    void AsyncLogAppender::append(const char *data, size_t len)
     {
-        // MutexType::Lock lock(m_mutex);
-        return m_formatter;
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        if (!reserve(lock, nullptr, LogLevel::UNKNOWN, len))
+        {
+            if (!m_running)
+            {
+                lock.unlock();
+                m_target->append(data, len);
+            }
+            return;
+        }
+        m_current->data.append(data, len);
     }
 
-    Logger::Logger(const std::string &name)
-        : m_name(name),
-          m_level(LogLevel::DEBUG) // 默认日志级别为DEBUG
+    void AsyncLogAppender::setOverflowPolicy(const LogOverflowPolicy &val)
     {
-        m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        m_policy = val;
+        m_spaceCond.notify_all();
     }
 
-    void Logger::setFormatter(LogFormatter::ptr val)
+    LogOverflowPolicy AsyncLogAppender::getOverflowPolicy()
     {
-        // MutexType::Lock lock(m_mutex);
-        m_formatter = val;
+        std::lock_guard<std::mutex> lock(m_queueMutex);
+        return m_policy;
+    }
 
-        for (auto &i : m_appenders)
+    bool AsyncLogAppender::reserve(std::unique_lock<std::mutex> &lock, const Logger::ptr &logger, LogLevel::Level level, size_t len)
+    {
+        while (m_running && m_current->size() + len > m_bufferSize && !m_current->empty())
         {
-            // MutexType::Lock ll(i->m_mutex);
-            if (!i->hasFormatter()) // 没有设置日志格式器的添加日志格式器
+            if (m_maxBuffers && m_buffers.size() >= m_maxBuffers)
             {
-                i->setFormatter(m_formatter);
+                if (!waitForSpace(lock, logger, level))
+                {
+                    return false;
+                }
+                // 等待期间其他线程可能已经换过缓冲，重新判断
+                continue;
             }
+            m_buffers.push_back(std::move(m_current));
+            m_queueDepth.fetch_add(1, std::memory_order_relaxed);
+            m_current = takeBuffer();
+            m_cond.notify_one();
+            break;
         }
+        return m_running;
     }
 
-    void Logger::setFormatter(const std::string &val)
+    bool AsyncLogAppender::waitForSpace(std::unique_lock<std::mutex> &lock, const Logger::ptr &logger, LogLevel::Level level)
     {
-        std::cout << "---" << val << std::endl;
-        LogFormatter::ptr new_val(new LogFormatter(val));
-        if (new_val->isError())
+        if (m_policy.action == LogOverflowPolicy::DROP_OLDEST)
+        {
+            // 丢掉最早的一块缓冲，按其中的行数计数
+            Buffer &oldest = m_buffers.front();
+            uint64_t lines = std::count(oldest->data.begin(), oldest->data.end(), '\n') + oldest->deferred.size();
+            m_dropped.fetch_add(lines, std::memory_order_relaxed);
+            m_metrics.addDropped(lines);
+            m_dropLogger = logger;
+            oldest->clear();
+            if (m_spares.size() < 2)
+            {
+                m_spares.push_back(std::move(oldest));
+            }
+            m_buffers.erase(m_buffers.begin());
+            m_queueDepth.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        auto has_space = [this]() { return !m_running || m_buffers.size() < m_maxBuffers; };
+        bool ok = false;
+        if (m_policy.shouldWait(level))
+        {
+            m_cond.notify_one();
+            if (m_policy.action == LogOverflowPolicy::BLOCK_TIMEOUT)
+            {
+                ok = m_spaceCond.wait_for(lock, std::chrono::milliseconds(m_policy.timeout), has_space);
+            }
+            else
+            {
+                m_spaceCond.wait(lock, has_space);
+                ok = true;
+            }
+            if (!m_running)
+            {
+                // 等待期间被停止，由调用者直接写入目标Appender
+                return false;
+            }
+        }
+        if (!ok)
+        {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            m_metrics.addDropped();
+            m_dropLogger = logger;
+        }
+        return ok;
+    }
+
+    void AsyncLogAppender::reportDropped(bool force)
+    {
+        uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+        if (dropped == m_reported)
         {
-            std::cout << "Logger setFormatter name=" << m_name
-                      << " value=" << val << " invalid formatter"
-                      << std::endl;
             return;
         }
-        //m_formatter = new_val;
-        setFormatter(new_val);
+        uint64_t now = GetCurrentNS();
+        if (!force && now < m_nextReport)
+        {
+            return;
+        }
+        // 日志器已经析构时(例如在本Appender的析构中)仍然报告，只是不带日志器名称
+        Logger::ptr logger;
+        {
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            logger = m_dropLogger.lock();
+        }
+        std::string msg;
+        getFormatter()->format(msg, logger.get(), LogLevel::WARN, *CreateDroppedEvent(logger, dropped - m_reported));
+        m_target->append(msg.data(), msg.size());
+        m_reported = dropped;
+        m_nextReport = now + kDropReportInterval;
     }
 
-    std::string Logger::toYamlString()
+    std::string AsyncLogAppender::toYamlString()
     {
-        // MutexType::Lock lock(m_mutex);
         // YAML::Node node;
-        // node["name"] = m_name;
-        // if (m_level != LogLevel::UNKNOW)
-        // {
-        //     node["level"] = LogLevel::ToString(m_level);
-        // }
-        // if (m_formatter)
-        // {
-        //     node["formatter"] = m_formatter->getPattern();
-        // }
-
-        // for (auto &i : m_appenders)
-        // {
-        //     node["appenders"].push_back(YAML::Load(i->toYamlString()));
-        // }
-        // std::stringstream ss;
-        // ss << node;
-        // return ss.str();
+        // node["type"] = "AsyncLogAppender";
+        // node["flush_interval"] = m_flushInterval;
+        // node["target"] = YAML::Load(m_target->toYamlString());
         return "";
     }
 
-    void Logger::addAppender(LogAppender::ptr appender)
+    void AsyncLogAppender::flush()
     {
-        // MutexType::Lock lock(m_mutex);
-        if (!appender->getFormatter())
+        std::unique_lock<std::mutex> lock(m_queueMutex);
+        if (!m_running)
         {
-            // MutexType::Lock ll(appender->m_mutex);
-            appender->setFormatter(m_formatter);
+            return;
         }
-        m_appenders.push_back(appender);
+        uint64_t seq = ++m_flushRequested;
+        m_cond.notify_one();
+        m_flushCond.wait(lock, [this, seq]() { return m_flushDone >= seq || !m_running; });
     }
 
-    void Logger::delAppender(LogAppender::ptr appender)
+    void AsyncLogAppender::stop()
     {
-        // MutexType::Lock lock(m_mutex);
-        for (auto it = m_appenders.begin();
-             it != m_appenders.end(); ++it)
         {
-            if (*it == appender)
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            if (!m_running)
             {
-                m_appenders.erase(it);
-                break;
+                return;
             }
+            m_running = false;
+            m_cond.notify_one();
+            m_spaceCond.notify_all();
         }
+        m_thread.join();
+        m_flushCond.notify_all();
     }
 
-    void Logger::clearAppenders()
+    AsyncLogAppender::Buffer AsyncLogAppender::takeBuffer()
     {
-        // MutexType::Lock lock(m_mutex);
-        m_appenders.clear();
+        if (!m_spares.empty())
+        {
+            Buffer buf = std::move(m_spares.back());
+            m_spares.pop_back();
+            return buf;
+        }
+        Buffer buf(new Chunk);
+        buf->data.reserve(m_bufferSize);
+        return buf;
     }
 
-    void Logger::log(LogLevel::Level level, LogEvent::ptr event)
+    void AsyncLogAppender::backend()
     {
-        if (level >= m_level)
+        std::vector<Buffer> writing;
+        bool running = true;
+        while (running)
         {
-            auto self = shared_from_this();
-            // MutexType::Lock lock(m_mutex);
-            if (!m_appenders.empty())
+            uint64_t flush_seq = 0;
             {
-                for (auto &i : m_appenders)
+                std::unique_lock<std::mutex> lock(m_queueMutex);
+                if (m_buffers.empty() && m_running && m_flushRequested == m_flushDone)
+                {
+                    m_cond.wait_for(lock, std::chrono::milliseconds(m_flushInterval.load()));
+                }
+                if (!m_current->empty())
                 {
-                    i->log(self, level, event);
+                    m_buffers.push_back(std::move(m_current));
+                    m_queueDepth.fetch_add(1, std::memory_order_relaxed);
+                    m_current = takeBuffer();
                 }
+                writing.swap(m_buffers);
+                m_spaceCond.notify_all();
+                flush_seq = m_flushRequested;
+                running = m_running;
+            }
+
+            for (auto &buf : writing)
+            {
+                write(*buf);
+                m_queueDepth.fetch_sub(1, std::memory_order_relaxed);
             }
-            else if (m_root)
+            reportDropped(!running);
+            m_target->flush();
+
+            std::lock_guard<std::mutex> lock(m_queueMutex);
+            // 只保留少量空缓冲，突发写入产生的多余缓冲直接释放
+            for (auto &buf : writing)
             {
-                m_root->log(level, event);
+                if (m_spares.size() < 2)
+                {
+                    buf->clear();
+                    m_spares.push_back(std::move(buf));
+                }
             }
+            writing.clear();
+            m_flushDone = flush_seq;
+            m_flushCond.notify_all();
         }
     }
 
-    void Logger::debug(LogEvent::ptr event)
+    void AsyncLogAppender::write(Chunk &chunk)
     {
-        log(LogLevel::DEBUG, event);
+        if (chunk.deferred.empty())
+        {
+            m_target->append(chunk.data.data(), chunk.data.size());
+            return;
+        }
+        // 按原顺序把前端格式化好的日志和后台渲染的日志拼成一块写出
+        std::string &out = m_rendered;
+        out.clear();
+        LogFormatter::ptr formatter = getFormatter();
+        size_t pos = 0;
+        for (const Deferred &i : chunk.deferred)
+        {
+            out.append(chunk.data, pos, i.offset - pos);
+            pos = i.offset;
+            Logger::ptr logger = i.logger.lock();
+            LogEvent::ptr event = LogEvent::Create(logger, i.level, i.filename, i.line, i.elapse, i.threadId,
+                                                   i.fiberId, i.time, i.threadName);
+            event->setDeferred(i.format, chunk.args.data() + i.args, i.argsLen);
+            event->setFields(chunk.args.data() + i.args + i.argsLen, i.fieldsLen);
+            formatEvent(*formatter, out, logger.get(), i.level, *event);
+        }
+        out.append(chunk.data, pos, std::string::npos);
+        m_target->append(out.data(), out.size());
+        // 突发的大块渲染结果不长期占用内存
+        if (out.capacity() > m_bufferSize * 2)
+        {
+            std::string().swap(out);
+        }
     }
 
-    void Logger::info(LogEvent::ptr event)
+    namespace
     {
-        log(LogLevel::INFO, event);
+        /**
+         * @brief 日志内容的哈希，每次处理8字节
+         */
+        uint64_t HashContent(const char *data, size_t len, uint64_t seed)
+        {
+            const uint64_t kMul = 0x9E3779B97F4A7C15ull;
+            uint64_t h = seed ^ (len * kMul);
+            while (len >= 8)
+            {
+                uint64_t k;
+                memcpy(&k, data, 8);
+                h = (h ^ k) * kMul;
+                h ^= h >> 29;
+                data += 8;
+                len -= 8;
+            }
+            uint64_t k = 0;
+            memcpy(&k, data, len);
+            h = (h ^ k) * kMul;
+            return h ^ (h >> 32);
+        }
     }
 
-    void Logger::warn(LogEvent::ptr event)
+    DedupLogAppender::DedupLogAppender(LogAppender::ptr target)
+        : m_target(target),
+          m_suppressed(0)
     {
-        log(LogLevel::WARN, event);
+        if (!target || !target->supportsAppend())
+        {
+            throw std::invalid_argument("DedupLogAppender target must support append()");
+        }
+        m_task = LogWorker::Instance().schedule(1000, std::bind(&DedupLogAppender::report, this));
     }
 
-    void Logger::error(LogEvent::ptr event)
+    DedupLogAppender::~DedupLogAppender()
     {
-        log(LogLevel::ERROR, event);
+        LogWorker::Instance().cancel(m_task);
+        Logger::ptr holder;
+        MutexType::Lock lock(m_mutex);
+        emitSummary(holder);
     }
 
-    void Logger::fatal(LogEvent::ptr event)
+    void DedupLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
     {
-        log(LogLevel::FATAL, event);
+        if (level < getLevel())
+        {
+            return;
+        }
+        const LogStream &ss = event->getSS();
+        uint64_t hash = HashContent(ss.data(), ss.size(), (uint64_t)(uintptr_t)event->getSite());
+
+        Logger::ptr holder;
+        MutexType::Lock lock(m_mutex);
+        if (isRepeat(level, *event, hash))
+        {
+            ++m_repeats;
+            m_lastRepeat = std::max(m_lastRepeat, event->getTimestamp());
+            m_suppressed.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        emitSummary(holder);
+        write(logger.get(), level, *event);
+        remember(level, *event, hash);
     }
 
-    void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    bool DedupLogAppender::isRepeat(LogLevel::Level level, const LogEvent &event, uint64_t hash) const
     {
-        if (level >= m_level)
+        const LogStream &ss = event.getSS();
+        if (hash != m_lastHash || level != m_lastLevel || event.getSite() != m_lastSite ||
+            event.getLogger().get() != m_lastLoggerPtr || event.getDeferFormat() != m_lastDeferFormat ||
+            ss.size() != m_lastContent.size() || event.getFields() != m_lastFields)
+        {
+            return false;
+        }
+        if (!m_lastSite && (event.getFilename() != m_lastFile || event.getLine() != m_lastLine))
         {
-            // MutexType::Lock lock(m_mutex);
-            m_formatter->format(std::cout, logger, level, event);
+            return false;
         }
+        return memcmp(ss.data(), m_lastContent.data(), ss.size()) == 0;
     }
 
-    std::string StdoutLogAppender::toYamlString()
+    void DedupLogAppender::remember(LogLevel::Level level, const LogEvent &event, uint64_t hash)
+    {
+        m_lastLogger = event.getLogger();
+        m_lastLoggerPtr = event.getLogger().get();
+        m_lastSite = event.getSite();
+        m_lastFile = event.getFilename();
+        m_lastLine = event.getLine();
+        m_lastDeferFormat = event.getDeferFormat();
+        m_lastContent.assign(event.getSS().data(), event.getSS().size());
+        m_lastFields = event.getFields();
+        m_lastThreadId = event.getThreadId();
+        m_lastThreadName = event.getThreadName();
+        m_lastTime = event.getTimestamp();
+        m_lastLevel = level;
+        m_lastHash = hash;
+        m_lastRepeat = 0;
+    }
+
+    std::string DedupLogAppender::toYamlString()
     {
-        // MutexType::Lock lock(m_mutex);
         // YAML::Node node;
-        // node["type"] = "StdoutLogAppender";
-        // if (m_level != LogLevel::UNKNOW)
-        // {
-        //     node["level"] = LogLevel::ToString(m_level);
-        // }
-        // if (m_hasFormatter && m_formatter)
-        // {
-        //     node["formatter"] = m_formatter->getPattern();
-        // }
-        // std::stringstream ss;
-        // ss << node;
-        // return ss.str();
+        // node["type"] = "DedupLogAppender";
+        // node["target"] = YAML::Load(m_target->toYamlString());
         return "";
     }
 
+    void DedupLogAppender::append(const char *data, size_t len)
+    {
+        Logger::ptr holder;
+        MutexType::Lock lock(m_mutex);
+        emitSummary(holder);
+        m_target->append(data, len);
+    }
+
+    void DedupLogAppender::flush()
+    {
+        Logger::ptr holder;
+        MutexType::Lock lock(m_mutex);
+        emitSummary(holder);
+        m_target->flush();
+    }
+
+    void DedupLogAppender::emitSummary(Logger::ptr &holder)
+    {
+        if (!m_repeats)
+        {
+            return;
+        }
+        // 汇总沿用被重复日志的调用点和级别，时间取最后一次重复
+        uint64_t repeats = m_repeats;
+        m_repeats = 0;
+        holder = m_lastLogger.lock();
+        const Logger::ptr &logger = holder;
+        if (!logger)
+        {
+            // 日志器已经销毁(通常是析构时)，没法按格式输出
+            std::string fallback;
+            std::string &msg = GetFormatBuffer(fallback);
+            msg = "[tensir] last message repeated " + std::to_string(repeats) + " times\n";
+            m_target->append(msg.data(), msg.size());
+            return;
+        }
+        LogEvent::ptr event = m_lastSite
+                                  ? LogEvent::Create(logger, m_lastLevel, m_lastSite, LogThread::GetElapse(), m_lastThreadId, 0,
+                                                     m_lastRepeat, m_lastThreadName)
+                                  : LogEvent::Create(logger, m_lastLevel, m_lastFile, m_lastLine, LogThread::GetElapse(),
+                                                     m_lastThreadId, 0, m_lastRepeat, m_lastThreadName);
+        // 各线程的时间戳在加锁前取得，不保证单调
+        uint64_t span = m_lastRepeat > m_lastTime ? (m_lastRepeat - m_lastTime) / 1000000 : 0;
+        event->getSS() << "last message repeated " << repeats << " times in " << span << " ms";
+        write(logger.get(), m_lastLevel, *event);
+    }
+
+    void DedupLogAppender::write(Logger *logger, LogLevel::Level level, const LogEvent &event)
+    {
+        std::string fallback;
+        std::string &msg = GetFormatBuffer(fallback);
+        msg.clear();
+        formatEvent(*m_formatter, msg, logger, level, event);
+        m_target->append(msg.data(), msg.size());
+    }
+
+    void DedupLogAppender::report()
+    {
+        // 其他线程可能同时放掉日志器，holder在解锁后才释放，日志器析构时本Appender的析构函数可以重新加锁
+        Logger::ptr holder;
+        MutexType::Lock lock(m_mutex);
+        emitSummary(holder);
+    }
+
+    LoggerManager::LoggerTable::LoggerTable(size_t capacity)
+        : mask(capacity - 1),
+          slots(new std::atomic<const LoggerEntry *>[capacity])
+    {
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+    }
+
+    const LoggerManager::LoggerEntry *LoggerManager::LoggerTable::find(const std::string &name, size_t hash) const
+    {
+        for (size_t i = hash & mask;; i = (i + 1) & mask)
+        {
+            const LoggerEntry *entry = slots[i].load(std::memory_order_acquire);
+            if (!entry || (entry->hash == hash && entry->name == name))
+            {
+                return entry;
+            }
+        }
+    }
+
+    void LoggerManager::LoggerTable::insert(const LoggerEntry *entry) const
+    {
+        for (size_t i = entry->hash & mask;; i = (i + 1) & mask)
+        {
+            if (!slots[i].load(std::memory_order_relaxed))
+            {
+                // 条目构造完成后才发布，读者用acquire读到指针即可看到完整的内容
+                slots[i].store(entry, std::memory_order_release);
+                return;
+            }
+        }
+    }
+
     LoggerManager::LoggerManager()
+        : m_loggers(new LoggerTable(64))
     {
         m_root.reset(new Logger);
         m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
 
-        m_loggers[m_root->getName()] = m_root;
+        m_entries.emplace_back(new LoggerEntry{m_root->getName(), std::hash<std::string>()(m_root->getName()), m_root});
+        m_loggers.get()->insert(m_entries.back().get());
 
         init();
     }
 
     Logger::ptr LoggerManager::getLogger(const std::string &name)
     {
-        // MutexType::Lock lock(m_mutex);
-        auto it = m_loggers.find(name);
-        if (it != m_loggers.end())
+        size_t hash = std::hash<std::string>()(name);
+        {
+            RcuPtr<LoggerTable>::ReadGuard table(m_loggers);
+            if (const LoggerEntry *entry = table->find(name, hash))
+            {
+                return entry->logger;
+            }
+        }
+
+        MutexType::Lock lock(m_mutex);
+        return getOrCreate(name, hash);
+    }
+
+    Logger::ptr LoggerManager::getOrCreate(const std::string &name, size_t hash)
+    {
+        const LoggerTable *table = m_loggers.get();
+        if (const LoggerEntry *entry = table->find(name, hash))
         {
-            return it->second;
+            return entry->logger;
         }
 
+        size_t pos = name.rfind('.');
+        Logger::ptr parent = m_root;
+        if (pos != std::string::npos && pos != 0)
+        {
+            std::string parent_name = name.substr(0, pos);
+            parent = getOrCreate(parent_name, std::hash<std::string>()(parent_name));
+        }
         Logger::ptr logger(new Logger(name));
-        logger->setRoot(m_root);
-        m_loggers[name] = logger;
+        logger->setParent(parent);
+        logger->setLevel(LogLevel::UNKNOWN);
+
+        m_entries.emplace_back(new LoggerEntry{name, hash, logger});
+        table = m_loggers.get();
+        if (m_entries.size() * 2 > table->capacity())
+        {
+            // 换成两倍大小的新表，旧表在读者退出后释放
+            LoggerTable *bigger = new LoggerTable(table->capacity() * 2);
+            for (auto &i : m_entries)
+            {
+                bigger->insert(i.get());
+            }
+            m_loggers.reset(bigger);
+        }
+        else
+        {
+            table->insert(m_entries.back().get());
+        }
         return logger;
     }
 
@@ -646,6 +3861,102 @@ namespace tensir
         return "";
     }
 
+    LoggerManager::MetricsReport LoggerManager::getMetrics()
+    {
+        std::vector<Logger::ptr> loggers;
+        {
+            MutexType::Lock lock(m_mutex);
+            for (auto &i : m_entries)
+            {
+                loggers.push_back(i->logger);
+            }
+        }
+        std::sort(loggers.begin(), loggers.end(), [](const Logger::ptr &a, const Logger::ptr &b) {
+            return a->getName() < b->getName();
+        });
+
+        MetricsReport report;
+        std::unordered_set<LogAppender *> seen;
+        for (auto &logger : loggers)
+        {
+            MetricsEntry entry = {logger->getName(), logger->getMetrics().snapshot()};
+            report.loggers.push_back(entry);
+
+            std::vector<LogAppender::ptr> appenders = logger->getAppenders();
+            for (size_t i = 0; i < appenders.size(); ++i)
+            {
+                LogAppender *appender = appenders[i].get();
+                if (!seen.insert(appender).second)
+                {
+                    continue;
+                }
+                const char *mangled = typeid(*appender).name();
+                int status = 0;
+                char *demangled = abi::__cxa_demangle(mangled, nullptr, nullptr, &status);
+                std::string type = status == 0 && demangled ? demangled : mangled;
+                free(demangled);
+                MetricsEntry appender_entry = {logger->getName() + "/" + type + "#" + std::to_string(i),
+                                               appender->getMetrics().snapshot()};
+                report.appenders.push_back(appender_entry);
+            }
+        }
+        return report;
+    }
+
+    namespace
+    {
+        void AppendHistogramJson(std::string &out, const char *name, const LogMetrics::Histogram &h)
+        {
+            out.append(",\"");
+            out.append(name);
+            out.append("\":{\"count\":");
+            AppendUInt(out, h.count);
+            out.append(",\"mean_ns\":");
+            AppendUInt(out, (uint64_t)h.mean());
+            out.append(",\"p50_ns\":");
+            AppendUInt(out, h.percentile(0.5));
+            out.append(",\"p99_ns\":");
+            AppendUInt(out, h.percentile(0.99));
+            out.append(",\"p999_ns\":");
+            AppendUInt(out, h.percentile(0.999));
+            out.append("}");
+        }
+
+        void AppendMetricsJson(std::string &out, const std::vector<LoggerManager::MetricsEntry> &entries)
+        {
+            out.push_back('[');
+            for (size_t i = 0; i < entries.size(); ++i)
+            {
+                const LogMetrics::Snapshot &m = entries[i].metrics;
+                out.append(i ? ",{\"name\":" : "{\"name\":");
+                AppendJsonString(out, entries[i].name.data(), entries[i].name.size());
+                out.append(",\"accepted\":");
+                AppendUInt(out, m.accepted);
+                out.append(",\"filtered\":");
+                AppendUInt(out, m.filtered);
+                out.append(",\"dropped\":");
+                AppendUInt(out, m.dropped);
+                out.append(",\"bytes\":");
+                AppendUInt(out, m.bytes);
+                AppendHistogramJson(out, "format_time", m.formatTime);
+                AppendHistogramJson(out, "write_time", m.writeTime);
+                out.push_back('}');
+            }
+            out.push_back(']');
+        }
+    }
+
+    std::string LoggerManager::getMetricsJson()
+    {
+        MetricsReport report = getMetrics();
+        std::string out = "{\"loggers\":";
+        AppendMetricsJson(out, report.loggers);
+        out.append(",\"appenders\":");
+        AppendMetricsJson(out, report.appenders);
+        out.push_back('}');
+        return out;
+    }
+
     void LoggerManager::init()
     {
     }
@@ -18,49 +18,160 @@
 #include <vector>
 #include <stdarg.h>
 #include <map>
+#include <unordered_map>
 #include <tuple>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "../Common/Util.h"
+#include "../Common/Mutex.h"
+#include "../Common/Rcu.h"
+#include "LogStream.h"
+#include "LogArgs.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/**
+ * @brief 编译期最低日志级别(取LogLevel::Level的数值)，低于该级别的日志语句连同参数一起被编译掉
+ */
+#ifndef TENSIR_LOG_ACTIVE_LEVEL
+#define TENSIR_LOG_ACTIVE_LEVEL 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TENSIR_LIKELY(x) __builtin_expect(!!(x), 1)
+#define TENSIR_UNLIKELY(x) __builtin_expect(!!(x), 0)
+#else
+#define TENSIR_LIKELY(x) (x)
+#define TENSIR_UNLIKELY(x) (x)
+#endif
+
+/**
+ * @brief 日志语句是否需要执行，logger和level各求值一次
+ * @details 依次检查编译期级别、所有日志器的最低级别(一个原子变量)和logger自身的级别，
+ *          绝大多数被关闭的语句只付出一次原子读和一个分支
+ */
+#define TENSIR_LOG_ENABLED(logger, level) TENSIR_UNLIKELY(tensir::Logger::ShouldLog((logger), (level)))
+
+/**
+ * @brief 返回当前调用点的静态描述符，第一次执行时注册到LogSiteRegistry
+ * @return 调用点被禁用或enabled为false时返回nullptr，此时不会初始化调用点
+ */
+#define TENSIR_LOG_SITE(enabled, level)                                                         \
+    [](bool _enabled, const char *_func, tensir::LogLevel::Level _level) -> tensir::LogSite * { \
+        if (!_enabled)                                                                          \
+        {                                                                                       \
+            return nullptr;                                                                     \
+        }                                                                                       \
+        static tensir::LogSite s_site(__FILE__, __LINE__, _func, _level);                       \
+        return s_site.isEnabled() ? &s_site : nullptr;                                          \
+    }(enabled, __func__, level)
+
+/**
+ * @brief 级别打开且cond成立时生成日志事件，并在语句结束时写入到logger
+ * @details level和logger各只求值一次，编译期和全局级别检查不通过时logger不求值；
+ *          cond在级别检查之后求值，被拒绝的语句不会生成日志事件
+ */
+#define TENSIR_LOG_EVENT_IF(logger, level, cond)                                                                   \
+    if (tensir::LogLevel::Level _tensir_level = (level))                                                           \
+    if (TENSIR_UNLIKELY(_tensir_level >= TENSIR_LOG_ACTIVE_LEVEL && tensir::Logger::IsLevelActive(_tensir_level))) \
+    if (const auto &_tensir_logger = (logger))                                                                     \
+    if (tensir::LogSite *_tensir_site =                                                                            \
+            TENSIR_LOG_SITE(_tensir_logger->getLevel() <= _tensir_level && (cond), _tensir_level))                 \
+    tensir::LogEventWrapper(tensir::LogEvent::Create(_tensir_logger, _tensir_level, _tensir_site))
+
+/**
+ * @brief 生成日志事件并在语句结束时写入到logger
+ */
+#define TENSIR_LOG_EVENT(logger, level) TENSIR_LOG_EVENT_IF(logger, level, true)
+
+/**
+ * @brief 调用点的限流条件，每个宏展开处有一份函数内静态的计数状态
+ */
+#define TENSIR_LOG_LIMIT_EVERY_N(n)                                          \
+    [](uint64_t _n) -> bool {                                                \
+        static std::atomic<uint64_t> s_state(0);                             \
+        return tensir::LogLimiter::EveryN(s_state, _n);                      \
+    }(n)
+#define TENSIR_LOG_LIMIT_FIRST_N(n)                                          \
+    [](uint64_t _n) -> bool {                                                \
+        static std::atomic<uint64_t> s_state(0);                             \
+        return tensir::LogLimiter::FirstN(s_state, _n);                      \
+    }(n)
+#define TENSIR_LOG_LIMIT_EVERY_MS(ms)                                        \
+    [](uint64_t _ms) -> bool {                                               \
+        static std::atomic<uint64_t> s_state(0);                             \
+        return tensir::LogLimiter::EveryMs(s_state, _ms);                    \
+    }(ms)
 
 /**
  * @brief 使用流式方式将日志级别level的日志写入到logger
  */
-#define TENSIR_LOG_LEVEL(logger, level)                                          \
-    if (logger->getLevel() <= level)                                             \
-    tensir::LogEventWrapper(tensir::LogEvent::ptr(new tensir::LogEvent(logger,   \
-                                                                       level,    \
-                                                                       __FILE__, \
-                                                                       __LINE__, \
-                                                                       0,        \
-                                                                       1,        \
-                                                                       1,        \
-                                                                       time(0),  \
-                                                                       "main"))) \
-        .getSS()
+#define TENSIR_LOG_LEVEL(logger, level) TENSIR_LOG_EVENT(logger, level).getSS()
+
 /**
  * @brief 使用流式方式将日志级别debug的日志写入到logger
  */
 #define TENSIR_LOG_DEBUG(logger) TENSIR_LOG_LEVEL(logger, tensir::LogLevel::DEBUG)
 
+/**
+ * @brief 每n次执行只输出第1次、第n+1次...
+ */
+#define TENSIR_LOG_EVERY_N(logger, level, n) TENSIR_LOG_EVENT_IF(logger, level, TENSIR_LOG_LIMIT_EVERY_N(n)).getSS()
+
+/**
+ * @brief 只输出前n次
+ */
+#define TENSIR_LOG_FIRST_N(logger, level, n) TENSIR_LOG_EVENT_IF(logger, level, TENSIR_LOG_LIMIT_FIRST_N(n)).getSS()
+
+/**
+ * @brief 每ms毫秒最多输出一次
+ */
+#define TENSIR_LOG_EVERY_MS(logger, level, ms) TENSIR_LOG_EVENT_IF(logger, level, TENSIR_LOG_LIMIT_EVERY_MS(ms)).getSS()
+
+/**
+ * @brief 以probability(0~1)的概率输出
+ */
+#define TENSIR_LOG_SAMPLED(logger, level, probability)                       \
+    TENSIR_LOG_EVENT_IF(logger, level, tensir::LogLimiter::Sample(probability)).getSS()
+
 /**
  * @brief 使用格式化方式将日志级别level的日志写入到logger
  */
-#define TENSIR_LOG_FMT_LEVEL(logger, level, fmt, ...)                            \
-    if (logger->getLevel() <= level)                                             \
-    tensir::LogEventWrapper(tensir::LogEvent::ptr(new tensir::LogEvent(logger,   \
-                                                                       level,    \
-                                                                       __FILE__, \
-                                                                       __LINE__, \
-                                                                       0,        \
-                                                                       1,        \
-                                                                       1,        \
-                                                                       time(0),  \
-                                                                       "main"))) \
-        .getEvent()                                                              \
-        ->format(fmt, __VA_ARGS__)
+#define TENSIR_LOG_FMT_LEVEL(logger, level, fmt, ...) TENSIR_LOG_EVENT(logger, level).getEvent()->format(fmt, __VA_ARGS__)
 
 /**
  * @brief 使用格式化方式将日志级别debug的日志写入到logger
  */
-#define TENSIR_LOG_FMT_DEBUG(logger, fmt, ...) TENSIR_LOG_FMT_LEVEL(logger, tensir::LogLevel::DEBUG, fmt, __VA__ARGS__)
+#define TENSIR_LOG_FMT_DEBUG(logger, fmt, ...) TENSIR_LOG_FMT_LEVEL(logger, tensir::LogLevel::DEBUG, fmt, __VA_ARGS__)
+
+/**
+ * @brief 格式化方式的TENSIR_LOG_EVERY_N/FIRST_N/EVERY_MS/SAMPLED
+ */
+#define TENSIR_LOG_FMT_EVERY_N(logger, level, n, fmt, ...)                   \
+    TENSIR_LOG_EVENT_IF(logger, level, TENSIR_LOG_LIMIT_EVERY_N(n)).getEvent()->format(fmt, __VA_ARGS__)
+#define TENSIR_LOG_FMT_FIRST_N(logger, level, n, fmt, ...)                   \
+    TENSIR_LOG_EVENT_IF(logger, level, TENSIR_LOG_LIMIT_FIRST_N(n)).getEvent()->format(fmt, __VA_ARGS__)
+#define TENSIR_LOG_FMT_EVERY_MS(logger, level, ms, fmt, ...)                 \
+    TENSIR_LOG_EVENT_IF(logger, level, TENSIR_LOG_LIMIT_EVERY_MS(ms)).getEvent()->format(fmt, __VA_ARGS__)
+#define TENSIR_LOG_FMT_SAMPLED(logger, level, probability, fmt, ...)         \
+    TENSIR_LOG_EVENT_IF(logger, level, tensir::LogLimiter::Sample(probability)).getEvent()->format(fmt, __VA_ARGS__)
+
+/**
+ * @brief 延迟格式化方式将日志级别level的日志写入到logger
+ * @details 调用线程只记录格式串指针和参数的二进制编码，文本在格式化时（通常是后台线程）才生成，
+ *          fmt必须是字符串字面量等生命周期足够长的字符串
+ */
+#define TENSIR_LOG_DEFER_LEVEL(logger, level, fmt, ...) TENSIR_LOG_EVENT(logger, level).getEvent()->defer(fmt, __VA_ARGS__)
+
+/**
+ * @brief 延迟格式化方式将日志级别debug的日志写入到logger
+ */
+#define TENSIR_LOG_DEFER_DEBUG(logger, fmt, ...) TENSIR_LOG_DEFER_LEVEL(logger, tensir::LogLevel::DEBUG, fmt, __VA_ARGS__)
 
 // /**
 //  * @brief 获取主日志器
@@ -76,6 +187,8 @@ namespace tensir
 {
     class Logger;
     class LoggerManager;
+    class LogEventPool;
+    class LogSiteRegistry;
     /**
      * @brief 日志级别
      */
@@ -108,43 +221,40 @@ namespace tensir
     };
 
     /**
-     * @brief 日志事件
+     * @brief 日志调用点
+     * @details 每个TENSIR_LOG_*宏展开处有一个函数内静态的LogSite，记录文件、行号、函数和级别，
+     *          第一次执行时注册并获得稳定的id。日志事件只引用调用点而不拷贝这些字段，
+     *          isEnabled()可以在运行时单独打开或关闭某个调用点
      */
-    class LogEvent
+    class LogSite
     {
     public:
-        typedef std::shared_ptr<LogEvent> ptr;
-        LogEvent() {}
-
         /**
-         * @brief 构造函数
-         * @param[in] logger 日志器
-         * @param[in] level 日志级别
-         * @param[in] filename 文件名
+         * @brief 构造函数，注册到LogSiteRegistry
+         * @param[in] file 文件名(__FILE__)
          * @param[in] line 行号
-         * @param[in] elapse 程序启动依赖的耗时(毫秒)
-         * @param[in] thread_id 线程id
-         * @param[in] fiber_id 协程id
-         * @param[in] time 日志时间（秒）
-         * @param[in] thread_name 线程名称
+         * @param[in] function 函数名
+         * @param[in] level 日志级别
          */
-        LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *filename,
-                 uint32_t line, uint32_t elapse, uint32_t thread_id,
-                 uint32_t fiber_id, uint64_t time, const std::string &thread_name);
+        LogSite(const char *file, int32_t line, const char *function, LogLevel::Level level);
+
+        LogSite(const LogSite &) = delete;
+        LogSite &operator=(const LogSite &) = delete;
 
         /**
-         * @brief 返回日志器
+         * @brief 返回调用点id，从1开始
          */
-        std::shared_ptr<Logger> getLogger() const { return m_logger; }
+        uint32_t getId() const { return m_id; }
 
         /**
-         * @brief 返回日志级别
+         * @brief 返回文件名
          */
-        LogLevel::Level getLevel() const { return m_level; }
+        const char *getFile() const { return m_file; }
+
         /**
-         * @brief 返回文件名
+         * @brief 返回不含目录的文件名
          */
-        const char *getFilename() const { return m_filename; }
+        const char *getBasename() const { return m_basename; }
 
         /**
          * @brief 返回行号
@@ -152,439 +262,2068 @@ namespace tensir
         int32_t getLine() const { return m_line; }
 
         /**
-         * @brief 返回耗时
+         * @brief 返回函数名
          */
-        uint32_t getElapse() const { return m_elapse; }
+        const char *getFunction() const { return m_function; }
 
         /**
-         * @brief 返回线程ID
+         * @brief 返回调用点第一次执行时的日志级别
          */
-        uint32_t getThreadId() const { return m_threadId; }
+        LogLevel::Level getLevel() const { return m_level; }
 
         /**
-         * @brief 返回协程ID
+         * @brief 调用点是否打开
          */
-        uint32_t getFiberId() const { return m_fiberId; }
+        bool isEnabled() const { return m_enabled.load(std::memory_order_relaxed); }
 
         /**
-         * @brief 返回时间
+         * @brief 打开或关闭调用点
          */
-        uint64_t getTime() const { return m_time; }
+        void setEnabled(bool val) { m_enabled.store(val, std::memory_order_relaxed); }
 
-        /**
-         * @brief 返回线程名称
-         */
-        const std::string &getThreadName() const { return m_threadName; }
+    private:
+        friend class LogSiteRegistry;
+
+        /// 调用点id
+        uint32_t m_id = 0;
+        /// 文件名
+        const char *m_file;
+        /// 不含目录的文件名
+        const char *m_basename;
+        /// 行号
+        int32_t m_line;
+        /// 函数名
+        const char *m_function;
+        /// 日志级别
+        LogLevel::Level m_level;
+        /// 是否打开
+        std::atomic<bool> m_enabled;
+    };
 
+    /**
+     * @brief 调用点限流的判断函数，状态由宏展开处的静态原子变量保存，不加锁
+     */
+    class LogLimiter
+    {
+    public:
         /**
-         * @brief 返回日志内容
+         * @brief 第1、n+1、2n+1...次返回true
          */
-        std::string getContent() const { return m_ss.str(); }
+        static bool EveryN(std::atomic<uint64_t> &count, uint64_t n)
+        {
+            return n <= 1 || count.fetch_add(1, std::memory_order_relaxed) % n == 0;
+        }
 
         /**
-         * @brief 返回日志内容字符串流
+         * @brief 前n次返回true，之后只读不写，不再争用缓存行
          */
-        std::stringstream &getSS() { return m_ss; }
+        static bool FirstN(std::atomic<uint64_t> &count, uint64_t n)
+        {
+            return count.load(std::memory_order_relaxed) < n && count.fetch_add(1, std::memory_order_relaxed) < n;
+        }
 
         /**
-         * @brief 格式化写入日志内容
+         * @brief 距上次返回true超过ms毫秒时返回true，并发调用中只有一个成功
+         * @param[in] last 上次返回true的时间(毫秒)，初始为0
          */
-        void format(const char *fmt, ...);
+        static bool EveryMs(std::atomic<uint64_t> &last, uint64_t ms)
+        {
+            // 粗粒度单调时钟由vDSO读取，精度(通常几毫秒)对限流足够
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+            uint64_t now = (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 + 1;
+            uint64_t prev = last.load(std::memory_order_relaxed);
+            return (prev == 0 || now - prev >= ms) &&
+                   last.compare_exchange_strong(prev, now, std::memory_order_relaxed);
+        }
 
         /**
-         * @brief 格式化写入日志内容
+         * @brief 以probability的概率返回true，使用线程局部的随机数发生器
          */
-        void format(const char *fmt, va_list al);
+        static bool Sample(double probability)
+        {
+            if (probability >= 1.0)
+            {
+                return true;
+            }
+            if (!(probability > 0.0))
+            {
+                return false;
+            }
+            // 只用高53位与probability比较，避免64位整数与double转换的舍入问题
+            return (NextRandom() >> 11) * (1.0 / 9007199254740992.0) < probability;
+        }
 
     private:
-        /// 日志器
-        std::shared_ptr<Logger> m_logger;
-        /// 日志等级
-        LogLevel::Level m_level;
-        /// 文件名
-        const char *m_filename = nullptr;
-        /// 行号
-        int32_t m_line = 0;
-        /// 程序启动开始到现在的毫秒数
-        uint32_t m_elapse = 0;
-        /// 线程ID
-        uint32_t m_threadId = 0;
-        /// 协程ID
-        uint32_t m_fiberId = 0;
-        /// 时间戳
-        uint64_t m_time = 0;
-        /// 线程名称
-        std::string m_threadName;
-        /// 日志内容流
-        std::stringstream m_ss;
+        /**
+         * @brief 线程局部的xorshift64*随机数
+         */
+        static uint64_t NextRandom();
     };
 
     /**
-     * @brief 日志事件包装器
+     * @brief 日志调用点注册表
      */
-    class LogEventWrapper
+    class LogSiteRegistry
     {
     public:
         /**
-         * @brief 构造函数
-         * @param[in] e 日志事件
-         */
-        LogEventWrapper(LogEvent::ptr e);
-
-        /**
-         * @brief 析构函数
+         * @brief 注册调用点并分配id，按已设置的规则初始化打开状态
          */
-        ~LogEventWrapper();
+        static void Register(LogSite *site);
 
         /**
-         * @brief 获取日志事件
+         * @brief 根据id返回调用点，不存在返回nullptr
          */
-        LogEvent::ptr getEvent() const { return m_event; }
+        static LogSite *Get(uint32_t id);
 
         /**
-         * @brief 获取日志内容流
+         * @brief 返回所有已注册的调用点
          */
-        std::stringstream &getSS();
+        static std::vector<LogSite *> GetSites();
 
-    private:
         /**
-         * @brief 日志事件
+         * @brief 打开或关闭调用点
+         * @param[in] file 文件名，可以是完整路径或不含目录的文件名
+         * @param[in] line 行号，0表示文件中的所有调用点
+         * @param[in] enabled 是否打开
+         * @return 当前匹配到的调用点个数
+         * @details 规则会被记住，之后才注册的匹配调用点同样生效
          */
-        LogEvent::ptr m_event;
+        static size_t SetEnabled(const std::string &file, int32_t line, bool enabled);
     };
 
     /**
-     * @brief 日志格式化
+     * @brief 日志时间戳的时钟源
+     * @details 时间戳在打日志的线程上读取，TSC读数带kTscFlag标记原样保存在事件中，
+     *          格式化时才按后台线程校准的参数换算成CLOCK_REALTIME纳秒
      */
-    class LogFormatter
+    class LogClock
     {
     public:
-        typedef std::shared_ptr<LogFormatter> ptr;
+        enum Source
+        {
+            /// clock_gettime(CLOCK_REALTIME)，纳秒精度，默认
+            REALTIME = 0,
+            /// clock_gettime(CLOCK_REALTIME_COARSE)，精度为一个时钟节拍(通常1~4毫秒)
+            REALTIME_COARSE = 1,
+            /// 处理器时间戳计数器(x86为rdtsc，aarch64为cntvct_el0)
+            TSC = 2
+        };
+
+        /// 时间戳为TSC读数的标记位
+        static const uint64_t kTscFlag = 1ull << 63;
 
         /**
-         * @brief 构造函数
-         * @param[in] pattern 格式模板
-         * @details 
-         *  %m 消息
-         *  %p 日志级别
-         *  %r 累计毫秒数
-         *  %c 日志名称
-         *  %t 线程id
-         *  %n 换行
-         *  %d 时间
-         *  %f 文件名
-         *  %l 行号
-         *  %T 制表符
-         *  %F 协程id
-         *  %N 线程名称
-         *
-         *  默认格式 "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"
+         * @brief 切换时钟源，对之后生成的事件生效
+         * @details 第一次切到TSC时同步校准约10毫秒，之后由LogWorker每秒重新校准
+         * @return 计数器不可用(非x86/aarch64或x86不是恒定速率TSC)时保持原时钟源并返回false
          */
-        LogFormatter(const std::string &pattern);
+        static bool SetSource(Source source);
 
         /**
-         * @brief 返回格式化日志串
-         * @param[in] logger 日志器
-         * @param[in] level 日志级别
-         * @param[in] event 日志事件
+         * @brief 返回当前时钟源
          */
-        std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+        static Source GetSource() { return (Source)s_source.load(std::memory_order_relaxed); }
 
-        std::ostream &format(std::ostream &ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+        /**
+         * @brief 是否有可用的恒定速率计数器
+         */
+        static bool IsTscSupported();
 
         /**
-         * @brief 日志内容项格式化
+         * @brief 读取当前时间戳，TSC读数带kTscFlag，其他时钟源为纳秒
          */
-        class FormatItem
+        static uint64_t Now()
         {
-        public:
-            typedef std::shared_ptr<FormatItem> ptr;
-            /**
-             * @brief 析构函数
-             */
-            virtual ~FormatItem() {}
-            /**
-             * @brief 格式化日志到流
-             * @param[in, out] os 日志输出流
-             * @param[in] logger 日志器
-             * @param[in] level 日志等级
-             * @param[in] event 日志事件
-             */
-            virtual void format(std::ostream &os, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
-        };
+            switch (s_source.load(std::memory_order_relaxed))
+            {
+            case TSC:
+                return ReadTsc() | kTscFlag;
+            case REALTIME_COARSE:
+            {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+                return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+            }
+            default:
+                return GetCurrentNS();
+            }
+        }
 
         /**
-         * @brief 初始化,解析日志模板
+         * @brief 把Now()返回的时间戳换算为CLOCK_REALTIME纳秒
          */
-        void init();
+        static uint64_t ToNanos(uint64_t stamp)
+        {
+            return TENSIR_UNLIKELY(stamp & kTscFlag) ? TscToNanos(stamp & ~kTscFlag) : stamp;
+        }
 
         /**
-         * @brief 是否有错误
+         * @brief 用一对相邻读取的(TSC, CLOCK_REALTIME)更新换算参数，由LogWorker周期调用
          */
-        bool isError() const { return m_error; }
+        static void Calibrate();
 
         /**
-         * @brief 返回日志模板
+         * @brief 读取计数器
          */
-        const std::string getPattern() const { return m_pattern; }
+        static uint64_t ReadTsc()
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            return __rdtsc();
+#elif defined(__aarch64__)
+            uint64_t v;
+            __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+            return v;
+#else
+            return 0;
+#endif
+        }
 
     private:
-        /// 日志格式模板
-        std::string m_pattern;
-        /// 日志格式解析后格式
-        std::vector<FormatItem::ptr> m_items;
-        /// 是否有错误
-        bool m_error = false;
+        /**
+         * @brief 按最近一次校准把计数器读数换算为纳秒
+         */
+        static uint64_t TscToNanos(uint64_t tsc);
+
+    private:
+        /// 当前时钟源
+        static std::atomic<int> s_source;
     };
 
     /**
-     * @brief 日志输出目标
+     * @brief 线程局部的日志上下文
+     * @details 每个线程第一次打日志时初始化一次：缓存gettid，把pthread线程名读进定长数组后驻留，
+     *          之后每条日志只读线程局部变量，不再有系统调用。fork后子进程中的上下文会重新初始化
      */
-    class LogAppender
+    class LogThread
     {
     public:
-        typedef std::shared_ptr<LogAppender> ptr;
-        // typedef Spinlock MutexType;
+        /// 线程名缓冲大小(含结尾的0)，与pthread线程名的上限一致
+        static const size_t kNameSize = 16;
 
         /**
-         * @brief 析构函数
+         * @brief 返回当前线程的上下文
          */
-        virtual ~LogAppender() {}
+        static const LogThread &Current();
 
         /**
-         * @brief 写入日志
-         * @param[in] logger 日志器
-         * @param[in] level 日志级别
-         * @param[in] event 日志事件
+         * @brief 设置当前线程的名称，同时设置pthread线程名，超过15字节的部分被截断
          */
-        virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+        static void SetName(const std::string &name);
 
         /**
-         * @brief 将日志输出目标的配置转成YAML String
+         * @brief 驻留线程名，内容相同的名称返回同一个指针，进程结束前一直有效
          */
-        virtual std::string toYamlString() = 0;
+        static const char *Intern(const char *name);
 
         /**
-         * @brief 更改日志格式器
+         * @brief 返回进程启动到现在的毫秒数
+         * @details 读取粗粒度单调时钟(vDSO，不是系统调用)，精度通常为几毫秒
          */
-        void setFormatter(LogFormatter::ptr val);
+        static uint32_t GetElapse();
 
         /**
-         * @brief 获取日志格式器
+         * @brief 返回内核线程id
          */
-        LogFormatter::ptr getFormatter();
+        uint32_t getId() const { return m_id; }
 
         /**
-         * @brief 获取日志级别
+         * @brief 返回驻留后的线程名
          */
-        LogLevel::Level getLevel() const { return m_level; }
+        const char *getName() const { return m_name; }
+
+    private:
+        LogThread();
 
         /**
-         * @brief 设置日志级别
+         * @brief 返回当前线程可修改的上下文
          */
-        void setLevel(LogLevel::Level val) { m_level = val; }
+        static LogThread &Local();
 
         /**
-         * @brief 是否定义了日志格式
+         * @brief 重新读取线程id和线程名
          */
-        bool hasFormatter() { return m_hasFormatter; }
+        void refresh();
 
-    protected:
-        /// 日志级别
-        LogLevel::Level m_level = LogLevel::DEBUG;
-        /// 是否有自己的日志格式器
-        bool m_hasFormatter = false;
-        /// Mutex
-        // MutexType m_mutex;
-        /// 日志格式器
-        LogFormatter::ptr m_formatter;
+        /**
+         * @brief fork后在子进程中调用，刷新执行fork的线程的上下文
+         */
+        static void AfterFork();
+
+    private:
+        /// 内核线程id
+        uint32_t m_id = 0;
+        /// 线程名
+        char m_buf[kNameSize];
+        /// 驻留后的线程名
+        const char *m_name = "";
     };
 
     /**
-     * @brief 日志器
+     * @brief 日志事件
      */
-    class Logger : public std::enable_shared_from_this<Logger>
+    class LogEvent
     {
     public:
-        typedef std::shared_ptr<Logger> ptr;
-        // typedef Spinlock MutexType;
+        typedef std::shared_ptr<LogEvent> ptr;
+        LogEvent() {}
 
         /**
          * @brief 构造函数
-         * @param[in] name 日志器名称
-        */
-        Logger(const std::string &name = "root");
-
-        /**
-         * @brief 写日志
+         * @param[in] logger 日志器
          * @param[in] level 日志级别
-         * @param[in] event 日志事件
+         * @param[in] filename 文件名
+         * @param[in] line 行号
+         * @param[in] elapse 程序启动依赖的耗时(毫秒)
+         * @param[in] thread_id 线程id
+         * @param[in] fiber_id 协程id
+         * @param[in] time 日志时间，纳秒或LogClock::Now()的返回值
+         * @param[in] thread_name 线程名称，会被驻留
          */
-        void log(LogLevel::Level level, LogEvent::ptr event);
+        LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, const char *filename,
+                 uint32_t line, uint32_t elapse, uint32_t thread_id,
+                 uint32_t fiber_id, uint64_t time, const char *thread_name);
 
         /**
-         * @brief 写debug级别日志
-         * @param[in] event 日志事件
+         * @brief 从当前线程的事件池中取一个日志事件，参数同构造函数
+         * @details 事件对象和shared_ptr控制块放在同一块池化内存中，引用计数归零后整块回收到
+         *          申请它的线程，稳定状态下不再有堆分配。thread_name只保存指针，
+         *          必须是字符串字面量或LogThread::Intern的返回值
          */
-        void debug(LogEvent::ptr event);
+        static LogEvent::ptr Create(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const char *filename,
+                                    uint32_t line, uint32_t elapse, uint32_t thread_id,
+                                    uint32_t fiber_id, uint64_t time, const char *thread_name);
 
         /**
-         * @brief 写info级别日志
-         * @param[in] event 日志事件
+         * @brief 从当前线程的事件池中取一个引用调用点的日志事件
+         * @param[in] site 调用点，文件名和行号取自调用点
          */
-        void info(LogEvent::ptr event);
+        static LogEvent::ptr Create(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogSite *site,
+                                    uint32_t elapse, uint32_t thread_id,
+                                    uint32_t fiber_id, uint64_t time, const char *thread_name);
 
         /**
-         * @brief 写warn级别日志
-         * @param[in] event 日志事件
+         * @brief 从当前线程的事件池中取一个引用调用点的日志事件，
+         *        线程id、线程名和耗时取自当前线程的LogThread上下文
          */
-        void warn(LogEvent::ptr event);
+        static LogEvent::ptr Create(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogSite *site);
 
         /**
-         * @brief 写error级别日志
-         * @param[in] event 日志事件
+         * @brief 返回日志器
          */
-        void error(LogEvent::ptr event);
+        const std::shared_ptr<Logger> &getLogger() const { return m_logger; }
 
         /**
-         * @brief 写fatal级别日志
-         * @param[in] event 日志事件
+         * @brief 返回日志级别
          */
-        void fatal(LogEvent::ptr event);
-
+        LogLevel::Level getLevel() const { return m_level; }
         /**
-         * @brief 添加日志目标
-         * @param[in] appender 日志目标
+         * @brief 返回文件名
          */
-        void addAppender(LogAppender::ptr appender);
+        const char *getFilename() const { return m_site ? m_site->getFile() : m_filename; }
 
         /**
-         * @brief 删除日志目标
-         * @param[in] appender 日志目标
+         * @brief 返回行号
          */
-        void delAppender(LogAppender::ptr appender);
+        int32_t getLine() const { return m_site ? m_site->getLine() : m_line; }
 
         /**
-         * @brief 清空日志目标
+         * @brief 返回调用点，直接构造的事件没有调用点
          */
-        void clearAppenders();
+        const LogSite *getSite() const { return m_site; }
 
         /**
-         * @brief 返回日志级别
+         * @brief 返回耗时
+         */
+        uint32_t getElapse() const { return m_elapse; }
+
+        /**
+         * @brief 返回线程ID
+         */
+        uint32_t getThreadId() const { return m_threadId; }
+
+        /**
+         * @brief 返回协程ID
+         */
+        uint32_t getFiberId() const { return m_fiberId; }
+
+        /**
+         * @brief 返回时间（秒）
+         */
+        uint64_t getTime() const { return getTimestamp() / 1000000000ull; }
+
+        /**
+         * @brief 返回时间戳（纳秒），TSC读数在此时换算
+         */
+        uint64_t getTimestamp() const { return LogClock::ToNanos(m_time); }
+
+        /**
+         * @brief 返回LogClock::Now()读取的原始时间戳
+         */
+        uint64_t getStamp() const { return m_time; }
+
+        /**
+         * @brief 返回线程名称
+         */
+        const char *getThreadName() const { return m_threadName; }
+
+        /**
+         * @brief 返回日志内容，延迟格式化的事件在此时渲染
+         */
+        std::string getContent() const;
+
+        /**
+         * @brief 将日志内容追加到out，延迟格式化的事件在此时渲染
+         */
+        void appendContent(std::string &out) const;
+
+        /**
+         * @brief 返回日志内容流
+         */
+        LogStream &getSS() { return m_ss; }
+
+        /**
+         * @brief 返回日志内容流，可通过data()/size()直接读取内容而不拷贝
+         * @details 延迟格式化的事件中保存的是LogArgs编码后的参数
+         */
+        const LogStream &getSS() const { return m_ss; }
+
+        /**
+         * @brief 延迟格式化写入日志内容
+         * @param[in] fmt printf格式串，只保存指针
+         * @param[in] args 参数，按类型编码保存，字符串会被拷贝
+         */
+        template <class... Args>
+        void defer(const char *fmt, const Args &...args)
+        {
+            m_ss.clear();
+            m_deferFormat = fmt;
+            LogArgs::Encode(m_ss, args...);
+        }
+
+        /**
+         * @brief 是否为延迟格式化的事件
+         */
+        bool isDeferred() const { return m_deferFormat != nullptr; }
+
+        /**
+         * @brief 返回延迟格式化的格式串
+         */
+        const char *getDeferFormat() const { return m_deferFormat; }
+
+        /**
+         * @brief 用已编码的参数设置延迟格式化内容，供二进制日志解码使用
+         * @param[in] fmt printf格式串，只保存指针
+         * @param[in] data LogArgs编码后的参数
+         * @param[in] len 编码后的参数长度
+         */
+        void setDeferred(const char *fmt, const char *data, size_t len)
+        {
+            m_ss.clear();
+            m_deferFormat = fmt;
+            m_ss.append(data, len);
+        }
+
+        /**
+         * @brief 添加结构化字段
+         * @param[in] key 字段名，会被拷贝
+         * @param[in] value 字段值，按LogArgs的类型编码保存，不转成字符串
+         */
+        template <class T>
+        LogEvent &with(const char *key, const T &value)
+        {
+            LogArgs::Encode(m_fields, key, value);
+            return *this;
+        }
+
+        /**
+         * @brief 返回编码后的结构化字段，依次为LogArgs编码的字段名(STRING)和字段值
+         */
+        const std::string &getFields() const { return m_fields; }
+
+        /**
+         * @brief 用已编码的结构化字段替换当前字段，供异步后端重建事件使用
+         */
+        void setFields(const char *data, size_t len) { m_fields.assign(data, len); }
+
+        /**
+         * @brief 格式化写入日志内容
+         */
+        void format(const char *fmt, ...);
+
+        /**
+         * @brief 格式化写入日志内容
+         */
+        void format(const char *fmt, va_list al);
+
+    private:
+        friend class LogEventPool;
+
+        /**
+         * @brief 复用前重新设置事件，保留已分配的内容缓冲
+         */
+        void reset(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogSite *site,
+                   const char *filename, uint32_t line, uint32_t elapse, uint32_t thread_id,
+                   uint32_t fiber_id, uint64_t time, const char *thread_name);
+
+        /**
+         * @brief 回收到事件池时调用，释放对日志器的引用
+         */
+        void release();
+
+    private:
+        /// 日志器
+        std::shared_ptr<Logger> m_logger;
+        /// 日志等级
+        LogLevel::Level m_level;
+        /// 调用点
+        const LogSite *m_site = nullptr;
+        /// 文件名
+        const char *m_filename = nullptr;
+        /// 行号
+        int32_t m_line = 0;
+        /// 程序启动开始到现在的毫秒数
+        uint32_t m_elapse = 0;
+        /// 线程ID
+        uint32_t m_threadId = 0;
+        /// 协程ID
+        uint32_t m_fiberId = 0;
+        /// 时间戳，纳秒或带LogClock::kTscFlag的TSC读数
+        uint64_t m_time = 0;
+        /// 线程名称，字符串字面量或驻留的线程名
+        const char *m_threadName = "";
+        /// 延迟格式化的格式串
+        const char *m_deferFormat = nullptr;
+        /// 结构化字段
+        std::string m_fields;
+        /// 日志内容流
+        LogStream m_ss;
+    };
+
+    /**
+     * @brief 日志事件包装器
+     */
+    class LogEventWrapper
+    {
+    public:
+        /**
+         * @brief 构造函数
+         * @param[in] e 日志事件
+         */
+        LogEventWrapper(LogEvent::ptr &&e);
+
+        /**
+         * @brief 析构函数
+         */
+        ~LogEventWrapper();
+
+        /**
+         * @brief 获取日志事件
+         */
+        const LogEvent::ptr &getEvent() const { return m_event; }
+
+        /**
+         * @brief 添加结构化字段
+         * @details TENSIR_LOG_EVENT(logger, level).with("user", uid).with("cost_ms", 3.5).getSS() << "done";
+         */
+        template <class T>
+        LogEventWrapper &with(const char *key, const T &value)
+        {
+            m_event->with(key, value);
+            return *this;
+        }
+
+        /**
+         * @brief 获取日志内容流
+         */
+        LogStream &getSS();
+
+    private:
+        /**
+         * @brief 日志事件
+         */
+        LogEvent::ptr m_event;
+    };
+
+    /**
+     * @brief 日志格式化
+     */
+    class LogFormatter
+    {
+    public:
+        typedef std::shared_ptr<LogFormatter> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] pattern 格式模板
+         * @details 
+         *  %m 消息
+         *  %p 日志级别
+         *  %r 累计毫秒数
+         *  %c 日志名称
+         *  %t 线程id
+         *  %n 换行
+         *  %d 时间，格式同strftime，另外支持%N(纳秒)、%3N(毫秒)、%6N(微秒)等小数秒
+         *  %f 文件名
+         *  %l 行号
+         *  %T 制表符
+         *  %F 协程id
+         *  %N 线程名称
+         *  %K 结构化字段，logfmt形式的" key=value ..."，没有字段时为空
+         *
+         *  默认格式 "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"
+         *
+         *  模板为"json"或"logfmt"时每条日志输出为一行JSON或logfmt，
+         *  依次包含time、level、logger、tid、thread、file、line、msg和结构化字段
+         */
+        LogFormatter(const std::string &pattern);
+
+        /**
+         * @brief 返回格式化日志串
+         * @param[in] logger 日志器
+         * @param[in] level 日志级别
+         * @param[in] event 日志事件
+         */
+        std::string format(const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event);
+
+        std::ostream &format(std::ostream &ofs, const std::shared_ptr<Logger> &logger, LogLevel::Level level, const LogEvent::ptr &event);
+
+        /**
+         * @brief 将格式化结果追加到out
+         * @param[in, out] out 输出缓冲
+         * @param[in] logger 日志器
+         * @param[in] level 日志级别
+         * @param[in] event 日志事件
+         */
+        void format(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent &event) const;
+
+        /**
+         * @brief 格式化指令操作码
+         */
+        enum Opcode
+        {
+            /// 字面量，m_literals[offset, offset + len)
+            OP_LITERAL,
+            /// %m 消息
+            OP_MESSAGE,
+            /// %p 日志级别
+            OP_LEVEL,
+            /// %r 累计毫秒数
+            OP_ELAPSE,
+            /// %c 日志名称
+            OP_NAME,
+            /// %t 线程id
+            OP_THREAD_ID,
+            /// %d 时间，offset为m_dateFormats下标
+            OP_DATETIME,
+            /// %f 文件名
+            OP_FILENAME,
+            /// %l 行号
+            OP_LINE,
+            /// %F 协程id
+            OP_FIBER_ID,
+            /// %N 线程名称
+            OP_THREAD_NAME,
+            /// %K 结构化字段
+            OP_FIELDS,
+            /// 整行JSON，offset为m_dateFormats下标
+            OP_JSON,
+            /// 整行logfmt，offset为m_dateFormats下标
+            OP_LOGFMT
+        };
+
+        /**
+         * @brief 格式化指令
+         * @details 模板解析后编译成连续的指令数组，%n、%T等常量项与相邻的普通字符合并成一条字面量指令
+         */
+        struct Instruction
+        {
+            uint32_t op;
+            uint32_t offset;
+            uint32_t len;
+        };
+
+        /**
+         * @brief 初始化,解析日志模板
+         */
+        void init();
+
+        /**
+         * @brief 是否有错误
+         */
+        bool isError() const { return m_error; }
+
+        /**
+         * @brief 返回日志模板
+         */
+        const std::string getPattern() const { return m_pattern; }
+
+    private:
+        /**
+         * @brief 编译后的时间格式
+         */
+        struct DateFormat
+        {
+            /// 全局唯一id，作为线程局部缓存的键
+            uint64_t id;
+            /// 交给strftime的格式，%N、%3N等小数秒用占位符代替
+            std::string pattern;
+        };
+
+        /**
+         * @brief 输出时间，每个线程按秒缓存strftime的结果，只在秒数变化时重新生成
+         */
+        void formatDateTime(std::string &out, const DateFormat &fmt, uint64_t timestamp) const;
+
+        /**
+         * @brief 输出一行JSON，字段值直接转义写入out
+         */
+        void formatJson(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent &event,
+                        const DateFormat &date) const;
+
+        /**
+         * @brief 输出一行logfmt
+         */
+        void formatLogfmt(std::string &out, Logger *logger, LogLevel::Level level, const LogEvent &event,
+                          const DateFormat &date) const;
+
+    private:
+        /// 日志格式模板
+        std::string m_pattern;
+        /// 日志格式编译后的指令
+        std::vector<Instruction> m_program;
+        /// 所有字面量拼接成的常量池
+        std::string m_literals;
+        /// 时间格式
+        std::vector<DateFormat> m_dateFormats;
+        /// 是否有错误
+        bool m_error = false;
+    };
+
+    /**
+     * @brief 日志自身的运行指标
+     * @details 计数和耗时直方图分片保存，每个分片独占缓存行，线程按第一次使用的顺序轮流映射到分片，
+     *          写入只是一次通常无竞争的原子加，读取快照时才把所有分片加起来
+     */
+    class LogMetrics
+    {
+    public:
+        /// 分片数
+        static const size_t kShards = 16;
+        /// 直方图桶数，第0个桶统计0纳秒，第i个桶统计[2^(i-1), 2^i)纳秒，最后一个桶包含所有更大的值
+        static const size_t kBuckets = 24;
+
+        /**
+         * @brief 耗时直方图
+         */
+        struct Histogram
+        {
+            /// 各桶的次数
+            uint64_t buckets[kBuckets] = {};
+            /// 总次数
+            uint64_t count = 0;
+            /// 总耗时(纳秒)
+            uint64_t sum = 0;
+
+            /**
+             * @brief 返回平均耗时(纳秒)
+             */
+            double mean() const { return count ? (double)sum / count : 0; }
+
+            /**
+             * @brief 返回分位数所在桶的上界(纳秒)
+             * @param[in] p 0~1
+             */
+            uint64_t percentile(double p) const;
+        };
+
+        /**
+         * @brief 所有分片相加后的指标
+         */
+        struct Snapshot
+        {
+            /// 通过级别检查的日志条数
+            uint64_t accepted = 0;
+            /// 被级别过滤的日志条数，日志宏在生成事件之前就过滤掉的调用不计入
+            uint64_t filtered = 0;
+            /// 队列满或写入失败丢弃的日志条数
+            uint64_t dropped = 0;
+            /// 格式化输出以及异步后端写入的字节数，包括格式化之后才被丢弃的
+            uint64_t bytes = 0;
+            /// 采样的格式化耗时
+            Histogram formatTime;
+            /// 采样的格式化以外的写入耗时
+            Histogram writeTime;
+        };
+
+        LogMetrics();
+        LogMetrics(const LogMetrics &) = delete;
+        LogMetrics &operator=(const LogMetrics &) = delete;
+
+        void addAccepted() { add(&Counters::accepted, 1); }
+        void addFiltered() { add(&Counters::filtered, 1); }
+        void addDropped(uint64_t n = 1) { add(&Counters::dropped, n); }
+        void addBytes(uint64_t n) { add(&Counters::bytes, n); }
+        void addFormatTime(uint64_t ns) { addTime(&Counters::format, &Counters::formatSum, ns); }
+        void addWriteTime(uint64_t ns) { addTime(&Counters::write, &Counters::writeSum, ns); }
+
+        /**
+         * @brief 汇总所有分片
+         */
+        Snapshot snapshot() const;
+
+        /**
+         * @brief 返回耗时的采样间隔
+         */
+        static uint32_t GetTimingInterval() { return s_timingInterval.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 设置耗时的采样间隔，每个线程每interval条日志计时一条，0表示不计时，默认16
+         * @details 计时每条日志要多读几次时钟，采样后直方图的分布和平均值不变，次数为采样次数；计数不受影响
+         */
+        static void SetTimingInterval(uint32_t interval) { s_timingInterval.store(interval, std::memory_order_relaxed); }
+
+        /**
+         * @brief 当前线程的这一条日志是否计时
+         */
+        static bool ShouldTime()
+        {
+            static thread_local uint32_t t_countdown = 0;
+            static thread_local uint32_t t_random = 2463534242u;
+            uint32_t interval = GetTimingInterval();
+            if (!interval)
+            {
+                return false;
+            }
+            if (t_countdown <= 1)
+            {
+                // 间隔在[1, 2*interval-1]内随机，平均为interval，避免多个日志器交替打印时采样总落在同一个上
+                t_random ^= t_random << 13;
+                t_random ^= t_random >> 17;
+                t_random ^= t_random << 5;
+                t_countdown = 1 + t_random % (2 * interval - 1);
+                return true;
+            }
+            --t_countdown;
+            return false;
+        }
+
+        /**
+         * @brief 读取计时用的单调时钟(纳秒)
+         */
+        static uint64_t Now()
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+        }
+
+    private:
+        struct Counters
+        {
+            std::atomic<uint64_t> accepted;
+            std::atomic<uint64_t> filtered;
+            std::atomic<uint64_t> dropped;
+            std::atomic<uint64_t> bytes;
+            std::atomic<uint64_t> format[kBuckets];
+            std::atomic<uint64_t> formatSum;
+            std::atomic<uint64_t> write[kBuckets];
+            std::atomic<uint64_t> writeSum;
+        };
+
+        /**
+         * @brief 按缓存行对齐的分片
+         */
+        struct alignas(64) Shard
+        {
+            Counters counters;
+        };
+
+        /**
+         * @brief 返回当前线程的分片
+         */
+        Counters &local() const { return m_shards[ShardIndex()].counters; }
+
+        /**
+         * @brief 返回当前线程的分片下标
+         */
+        static size_t ShardIndex();
+
+        void add(std::atomic<uint64_t> Counters::*counter, uint64_t n)
+        {
+            (local().*counter).fetch_add(n, std::memory_order_relaxed);
+        }
+
+        void addTime(std::atomic<uint64_t> (Counters::*buckets)[kBuckets], std::atomic<uint64_t> Counters::*sum, uint64_t ns)
+        {
+            Counters &c = local();
+            size_t bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+            (c.*buckets)[bucket < kBuckets ? bucket : kBuckets - 1].fetch_add(1, std::memory_order_relaxed);
+            (c.*sum).fetch_add(ns, std::memory_order_relaxed);
+        }
+
+    private:
+        /// 分片的内存，按缓存行对齐后使用
+        std::unique_ptr<char[]> m_storage;
+        /// 分片
+        Shard *m_shards;
+        /// 耗时的采样间隔
+        static std::atomic<uint32_t> s_timingInterval;
+    };
+
+    /**
+     * @brief 日志输出目标
+     */
+    class LogAppender
+    {
+    public:
+        friend class Logger;
+
+    public:
+        typedef std::shared_ptr<LogAppender> ptr;
+        typedef Mutex MutexType;
+
+        /**
+         * @brief 析构函数
+         */
+        virtual ~LogAppender() {}
+
+        /**
+         * @brief 写入日志
+         * @param[in] logger 日志器
+         * @param[in] level 日志级别
+         * @param[in] event 日志事件
+         */
+        virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
+
+        /**
+         * @brief 将日志输出目标的配置转成YAML String
+         */
+        virtual std::string toYamlString() = 0;
+
+        /**
+         * @brief 写入已格式化好的日志数据
+         * @param[in] data 数据起始地址
+         * @param[in] len 数据长度
+         * @details AsyncLogAppender和DedupLogAppender通过它把格式化好的文本交给目标Appender。
+         *          不接收文本的Appender(如BinaryLogAppender)不实现，supportsAppend()返回false，不能作为它们的目标
+         */
+        virtual void append(const char *, size_t) {}
+
+        /**
+         * @brief 是否实现了append()
+         */
+        virtual bool supportsAppend() const { return false; }
+
+        /**
+         * @brief 将缓冲的日志数据刷到输出目标
+         */
+        virtual void flush() {}
+
+        /**
+         * @brief 更改日志格式器
+         */
+        void setFormatter(LogFormatter::ptr val);
+
+        /**
+         * @brief 获取日志格式器
+         */
+        LogFormatter::ptr getFormatter();
+
+        /**
+         * @brief 获取日志级别
+         */
+        LogLevel::Level getLevel() const { return (LogLevel::Level)m_level.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 设置日志级别
+         */
+        void setLevel(LogLevel::Level val) { m_level.store(val, std::memory_order_relaxed); }
+
+        /**
+         * @brief 是否定义了日志格式
+         */
+        bool hasFormatter() { return m_hasFormatter.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 返回运行指标
+         */
+        LogMetrics &getMetrics() { return m_metrics; }
+
+    protected:
+        /**
+         * @brief 格式化日志并追加到out，统计格式化耗时和字节数
+         */
+        void formatEvent(const LogFormatter &formatter, std::string &out, Logger *logger, LogLevel::Level level,
+                         const LogEvent &event);
+
+        /**
+         * @brief 统计不经过formatEvent写出的字节数
+         */
+        void addWritten(size_t len);
+
+    protected:
+        /// 日志级别
+        std::atomic<int> m_level{LogLevel::DEBUG};
+        /// 是否有自己的日志格式器，没有时跟随日志器的格式器
+        std::atomic<bool> m_hasFormatter{false};
+        /// Mutex，保护日志格式器和输出目标
+        MutexType m_mutex;
+        /// 日志格式器
+        LogFormatter::ptr m_formatter;
+        /// 运行指标
+        LogMetrics m_metrics;
+    };
+
+    /**
+     * @brief 日志队列满时的处理策略
+     * @details 用于AsyncLogAppender(按Appender设置)和LogDispatcher(按分发器设置，给日志器单独设置分发器即按日志器设置)。
+     *          丢弃的日志计数，由消费线程每秒最多一次输出一条"N log messages dropped"的WARN日志
+     */
+    struct LogOverflowPolicy
+    {
+        enum Action
+        {
+            /// 等待队列腾出空间
+            BLOCK = 0,
+            /// 最多等待timeout毫秒，超时后丢弃这条日志
+            BLOCK_TIMEOUT = 1,
+            /// 丢弃这条日志
+            DROP_NEWEST = 2,
+            /// 丢弃队列中最早的日志，LogDispatcher的无锁队列不支持，按DROP_NEWEST处理
+            DROP_OLDEST = 3,
+            /// 低于level的日志直接丢弃，其余等待
+            DROP_BELOW_LEVEL = 4
+        };
+
+        LogOverflowPolicy(Action action_ = BLOCK, uint32_t timeout_ = 0, LogLevel::Level level_ = LogLevel::WARN)
+            : action(action_), timeout(timeout_), level(level_)
+        {
+        }
+
+        /**
+         * @brief 队列满时level级别的日志是否等待
+         */
+        bool shouldWait(LogLevel::Level val) const
+        {
+            return action == BLOCK || action == BLOCK_TIMEOUT || (action == DROP_BELOW_LEVEL && val >= level);
+        }
+
+        /// 处理方式
+        Action action;
+        /// BLOCK_TIMEOUT的最长等待时间(毫秒)
+        uint32_t timeout;
+        /// DROP_BELOW_LEVEL的级别阈值
+        LogLevel::Level level;
+    };
+
+    /**
+     * @brief 日志分发器
+     * @details 每个生产线程拥有一个独立的有界SPSC环形队列，日志事件在无锁的情况下入队，
+     *          由单个消费线程轮询所有队列，再交给日志器的Appender链输出。
+     *          队列满时按LogOverflowPolicy等待或丢弃，默认让出CPU等待消费线程腾出空间
+     */
+    class LogDispatcher
+    {
+    public:
+        typedef std::shared_ptr<LogDispatcher> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] ring_capacity 每个线程环形队列的容量，向上取整为2的幂
+         */
+        LogDispatcher(size_t ring_capacity = 8192);
+
+        /**
+         * @brief 析构函数，消费完所有队列后停止消费线程
+         */
+        ~LogDispatcher();
+
+        /**
+         * @brief 将日志事件放入当前线程的队列
+         * @param[in] logger 日志器
+         * @param[in] level 日志级别
+         * @param[in] event 日志事件
+         * @return 分发器已停止或当前线程正在退出时返回false，由调用者同步输出；按策略丢弃时返回true
+         */
+        bool post(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+
+        /**
+         * @brief 等待调用前已入队的事件全部交给Appender
+         */
+        void flush();
+
+        /**
+         * @brief 停止消费线程，剩余事件会先被消费
+         */
+        void stop();
+
+        /**
+         * @brief 返回当前注册的生产队列个数
+         */
+        size_t getRingCount();
+
+        /**
+         * @brief 设置队列满时的处理策略
+         */
+        void setOverflowPolicy(const LogOverflowPolicy &val);
+
+        /**
+         * @brief 返回队列满时的处理策略
+         */
+        LogOverflowPolicy getOverflowPolicy();
+
+        /**
+         * @brief 返回丢弃的日志条数
+         */
+        uint64_t getDroppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 当前线程是否为某个分发器的消费线程
+         */
+        static bool InConsumer();
+
+        /// 单个生产线程的环形队列，定义在Log.cpp
+        class Ring;
+
+    private:
+
+        /**
+         * @brief 返回当前线程在本分发器中的队列，第一次调用时创建并注册
+         */
+        Ring *localRing();
+
+        /**
+         * @brief 消费线程主循环
+         */
+        void consume();
+
+        /**
+         * @brief 消费一轮所有队列
+         * @return 本轮消费的事件个数
+         */
+        size_t drain(std::vector<std::shared_ptr<Ring> > &rings);
+
+        /**
+         * @brief 有未报告的丢弃且距上次报告超过1秒时，通过logger输出一条丢弃条数日志，只在消费线程调用
+         */
+        void reportDropped(const std::shared_ptr<Logger> &logger);
+
+        /**
+         * @brief 入队后发现分发器已停止时调用，等stop()完成后由当前线程输出自己队列中剩余的事件
+         */
+        void drainStopped(Ring *ring);
+
+    private:
+        /// 分发器唯一id，用于线程局部缓存的匹配
+        uint64_t m_id;
+        /// 队列容量
+        size_t m_capacity;
+        /// 队列满时的处理策略，生产线程只在队列满时读取
+        LogOverflowPolicy m_policy;
+        /// 丢弃的日志条数
+        std::atomic<uint64_t> m_dropped;
+        /// 已报告的丢弃条数，只由消费线程访问
+        uint64_t m_reported = 0;
+        /// 下次可以报告的时间(纳秒)，只由消费线程访问
+        uint64_t m_nextReport = 0;
+        /// 保护m_rings
+        std::mutex m_mutex;
+        /// 唤醒消费线程
+        std::condition_variable m_cond;
+        /// 所有生产队列
+        std::vector<std::shared_ptr<Ring> > m_rings;
+        /// m_rings的版本号，消费线程据此刷新本地副本
+        std::atomic<uint64_t> m_version;
+        /// 消费线程是否在休眠
+        std::atomic<bool> m_sleeping;
+        /// 是否运行
+        std::atomic<bool> m_running;
+        /// 消费线程退出后串行化对队列的消费
+        std::mutex m_drainMutex;
+        /// stop()是否已完成，由m_drainMutex保护
+        bool m_stopped = false;
+        /// 消费线程
+        std::thread m_thread;
+    };
+
+    /**
+     * @brief 日志器
+     */
+    class Logger : public std::enable_shared_from_this<Logger>
+    {
+    public:
+        typedef std::shared_ptr<Logger> ptr;
+        typedef Mutex MutexType;
+
+        /**
+         * @brief 构造函数
+         * @param[in] name 日志器名称
+        */
+        Logger(const std::string &name = "root");
+
+        /**
+         * @brief 析构函数
+         */
+        ~Logger();
+
+        /**
+         * @brief 是否至少有一个日志器会接收该级别的日志
+         * @details 读取所有日志器级别中最低的一个，日志器创建、销毁、修改级别时更新
+         */
+        static bool IsLevelActive(LogLevel::Level level)
+        {
+            return level >= s_levelFloor.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief 日志语句是否需要执行，见TENSIR_LOG_ENABLED
+         * @param[in] logger 日志器，Logger::ptr或Logger*
+         */
+        template <class L>
+        static bool ShouldLog(const L &logger, LogLevel::Level level)
+        {
+            return level >= TENSIR_LOG_ACTIVE_LEVEL && IsLevelActive(level) && logger->getLevel() <= level;
+        }
+
+        /**
+         * @brief 写日志
+         * @param[in] level 日志级别
+         * @param[in] event 日志事件
+         */
+        void log(LogLevel::Level level, LogEvent::ptr event);
+
+        /**
+         * @brief 将日志事件直接交给生效的Appender链
+         * @param[in] level 日志级别
+         * @param[in] event 日志事件
+         * @details 由log()或分发器的消费线程调用，不再做级别过滤
+         */
+        void callAppenders(LogLevel::Level level, LogEvent::ptr event);
+
+        /**
+         * @brief 写debug级别日志
+         * @param[in] event 日志事件
+         */
+        void debug(LogEvent::ptr event);
+
+        /**
+         * @brief 写info级别日志
+         * @param[in] event 日志事件
+         */
+        void info(LogEvent::ptr event);
+
+        /**
+         * @brief 写warn级别日志
+         * @param[in] event 日志事件
+         */
+        void warn(LogEvent::ptr event);
+
+        /**
+         * @brief 写error级别日志
+         * @param[in] event 日志事件
+         */
+        void error(LogEvent::ptr event);
+
+        /**
+         * @brief 写fatal级别日志
+         * @param[in] event 日志事件
+         */
+        void fatal(LogEvent::ptr event);
+
+        /**
+         * @brief 添加日志目标
+         * @param[in] appender 日志目标
+         */
+        void addAppender(LogAppender::ptr appender);
+
+        /**
+         * @brief 删除日志目标
+         * @param[in] appender 日志目标
+         */
+        void delAppender(LogAppender::ptr appender);
+
+        /**
+         * @brief 清空日志目标
+         */
+        void clearAppenders();
+
+        /**
+         * @brief 返回生效的日志级别
+         * @details 没有设置级别时为最近一个设置了级别的祖先的级别，层级变化时预先算好
+         */
+        LogLevel::Level getLevel() const { return (LogLevel::Level)m_effectiveLevel.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 返回自己设置的日志级别，UNKNOWN表示继承
+         */
+        LogLevel::Level getConfiguredLevel() const { return (LogLevel::Level)m_level.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 设置日志级别
+         * @param[in] val 日志级别，UNKNOWN表示继承父日志器的级别
+         */
+        void setLevel(LogLevel::Level val);
+
+        /**
+         * @brief 返回日志名称
+         */
+        const std::string &getName() const { return m_name; }
+
+        /**
+         * @brief 设置日志格式器
+         */
+        void setFormatter(LogFormatter::ptr val);
+
+        /**
+         * @brief 设置日志格式模板
+         */
+        void setFormatter(const std::string &val);
+
+        /**
+         * @brief 获取日志格式器
+         */
+        LogFormatter::ptr getFormatter();
+
+        /**
+         * @brief 将日志器的配置转成YAML String
+         */
+        std::string toYamlString();
+
+        /**
+         * @brief 获得日志名称
+         */
+        std::string &getName() { return m_name; }
+
+        /**
+         * @brief 设置父日志器
+         * @details 没有日志目标、日志级别或分发器的日志器沿用父日志器的，会形成环时忽略
+         */
+        void setParent(Logger::ptr parent);
+
+        /**
+         * @brief 获得父日志器
+         */
+        Logger::ptr getParent() const;
+
+        /**
+         * @brief 设置日志分发器，为空时沿用父日志器的，都没有时在调用线程同步输出
+         */
+        void setDispatcher(LogDispatcher::ptr val);
+
+        /**
+         * @brief 获得日志分发器
+         */
+        LogDispatcher::ptr getDispatcher() const;
+
+        /**
+         * @brief 返回自己的日志目标集合的拷贝
+         */
+        std::vector<LogAppender::ptr> getAppenders() const;
+
+        /**
+         * @brief 返回运行指标，耗时和字节数为所有日志目标之和
+         */
+        LogMetrics &getMetrics() { return m_metrics; }
+
+    private:
+        /// 生效的日志目标快照，写日志时复制引用后即退出读临界区，不在临界区内做I/O
+        typedef std::shared_ptr<const std::vector<LogAppender::ptr>> AppenderList;
+
+        /**
+         * @brief 写日志时读取的配置，发布后不再修改
+         */
+        struct Config
+        {
+            /// 日志目标集合
+            std::vector<LogAppender::ptr> appenders;
+            /// 日志分发器
+            LogDispatcher::ptr dispatcher;
+            /// 父日志器
+            Logger::ptr parent;
+            /// 生效的日志目标，自己没有时为父日志器生效的日志目标，未发布过时为空指针
+            AppenderList effectiveAppenders;
+            /// 生效的日志分发器，自己没有时为父日志器生效的分发器
+            LogDispatcher::ptr effectiveDispatcher;
+        };
+
+        /// 被替换下来的配置，在释放层级锁之后析构(可能释放父日志器)
+        typedef std::vector<std::unique_ptr<const Config>> Garbage;
+
+        /**
+         * @brief 所有日志器共用的层级锁，串行化修改配置的一方，写日志不加锁
+         */
+        static MutexType &HierarchyMutex();
+
+        void callAppenders(LogLevel::Level level, const LogEvent::ptr &event, const AppenderList &appenders);
+
+        /**
+         * @brief 在读临界区内取出生效的日志目标和分发器
+         */
+        void snapshot(AppenderList &appenders, LogDispatcher::ptr *dispatcher) const;
+
+        /**
+         * @brief 计算生效的级别和日志目标后发布config，并重新计算所有子日志器，需持有层级锁
+         */
+        void publish(Config *config, Garbage &garbage);
+
+        /**
+         * @brief 复制当前配置交给fn修改后发布
+         */
+        template <class F>
+        void updateConfig(F fn)
+        {
+            Garbage garbage;
+            MutexType::Lock lock(HierarchyMutex());
+            Config *config = new Config(*m_config.get());
+            fn(*config);
+            publish(config, garbage);
+        }
+
+    private:
+        /// 日志名称
+        std::string m_name;
+        /// 设置的日志级别
+        std::atomic<int> m_level;
+        /// 生效的日志级别
+        std::atomic<int> m_effectiveLevel;
+        /// 当前配置，写日志的线程无锁读取快照，修改时整体替换
+        RcuPtr<Config> m_config;
+        /// 子日志器，由层级锁保护，子日志器析构时移除
+        std::vector<Logger *> m_children;
+        /// 日志格式器，由层级锁保护
+        LogFormatter::ptr m_formatter;
+        /// 运行指标
+        LogMetrics m_metrics;
+        /// 所有日志器中最低的日志级别
+        static std::atomic<int> s_levelFloor;
+    };
+
+    /**
+     * @brief 输出到控制台的Appender
+     */
+    class StdoutLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<StdoutLogAppender> ptr;
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        std::string toYamlString() override;
+        void append(const char *data, size_t len) override;
+        bool supportsAppend() const override { return true; }
+        void flush() override;
+    };
+
+    /**
+     * @brief 直接写标准输出/标准错误文件描述符的Appender
+     * @details 日志格式化到待写缓冲后立即返回，同一时刻只有一个线程(最先发现没有人在写的线程)
+     *          在锁外用writev写出积累的所有日志，其他线程只追加。待写缓冲有上限：
+     *          阻塞模式下超过上限时等待，非阻塞模式下管道或socket写不进时丢弃新日志并计数，
+     *          恢复后先输出一行丢弃条数。非阻塞模式对管道重新打开一个私有的文件描述，
+     *          对socket使用MSG_DONTWAIT，不修改与其他进程共享的文件状态；其他类型的输出仍然阻塞写
+     */
+    class ConsoleLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<ConsoleLogAppender> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] fd 输出的文件描述符，STDOUT_FILENO或STDERR_FILENO
+         * @param[in] nonblock 输出写不进时是否丢弃日志而不是等待
+         * @param[in] max_pending 待写缓冲上限(字节)
          */
-        LogLevel::Level getLevel() const { return m_level; }
+        ConsoleLogAppender(int fd = 1, bool nonblock = false, size_t max_pending = 1024 * 1024);
 
         /**
-         * @brief 设置日志级别
+         * @brief 析构函数，尽量写出剩余的日志
          */
-        void setLevel(LogLevel::Level val) { m_level = val; }
+        ~ConsoleLogAppender();
+
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        std::string toYamlString() override;
+        void append(const char *data, size_t len) override;
+        bool supportsAppend() const override { return true; }
 
         /**
-         * @brief 返回日志名称
+         * @brief 写出待写缓冲，非阻塞模式下写不进时直接返回
          */
-        const std::string &getName() const { return m_name; }
+        void flush() override;
 
         /**
-         * @brief 设置日志格式器
+         * @brief 是否以非阻塞方式写
          */
-        void setFormatter(LogFormatter::ptr val);
+        bool isNonblock() const { return m_nonblock; }
 
         /**
-         * @brief 设置日志格式模板
+         * @brief 返回丢弃的日志条数
          */
-        void setFormatter(const std::string &val);
+        uint64_t getDroppedCount();
 
+    private:
         /**
-         * @brief 获取日志格式器
+         * @brief 等待或丢弃，返回是否可以继续追加len字节，需持有m_mutex
          */
-        LogFormatter::ptr getFormatter();
+        bool reserve(MutexType::Lock &lock, size_t len);
 
         /**
-         * @brief 将日志器的配置转成YAML String
+         * @brief 没有其他线程在写时写出所有待写数据，期间会释放锁，需持有m_mutex
          */
-        std::string toYamlString();
+        void drain(MutexType::Lock &lock);
+
+    private:
+        /// 文件描述符
+        int m_fd;
+        /// 是否由自己打开
+        bool m_ownFd = false;
+        /// 是否为socket
+        bool m_socket = false;
+        /// 是否非阻塞
+        bool m_nonblock = false;
+        /// 待写缓冲上限
+        size_t m_maxPending;
+        /// 待写缓冲，其他线程在写时新日志追加到这里
+        std::string m_pending;
+        /// 正在写的数据
+        std::string m_batch;
+        /// m_batch中已经写出的字节数
+        size_t m_batchPos = 0;
+        /// 丢弃提示
+        std::string m_note;
+        /// m_note中已经写出的字节数
+        size_t m_notePos = 0;
+        /// 是否有线程正在写
+        bool m_draining = false;
+        /// 丢弃的日志条数
+        uint64_t m_dropped = 0;
+        /// 已经提示过的丢弃条数
+        uint64_t m_reported = 0;
+        /// 通知等待待写缓冲的线程
+        std::condition_variable_any m_cond;
+    };
+
+    /**
+     * @brief 输出到文件的Appender
+     * @details 日志先写入自己的缓冲，缓冲满或后台线程每秒检查时写入文件。
+     *          不滚动时写入filename，文件被外部移走或删除后由后台线程重新打开；
+     *          按大小或时间滚动时依次写入filename.1、filename.2 ...，下一个文件由后台线程预先打开并fallocate，
+     *          写日志的线程切换文件时只交换文件描述符，关闭旧文件和清理过期文件都在后台线程完成。
+     *          默认不主动落盘，可以用setDurability改为定期fdatasync或组提交
+     */
+    class FileLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<FileLogAppender> ptr;
 
         /**
-         * @brief 获得日志名称
+         * @brief 持久化方式
          */
-        std::string &getName() { return m_name; }
+        enum Durability
+        {
+            /// 只写入页缓存，由内核决定何时落盘
+            NONE = 0,
+            /// 后台线程按间隔fdatasync
+            PERIODIC = 1,
+            /// 组提交，不低于指定级别的日志等待所在批次落盘后返回，一次fdatasync覆盖期间写入的所有日志
+            GROUP_COMMIT = 2
+        };
+
+        /**
+         * @brief 构造函数
+         * @param[in] filename 文件路径，滚动时为文件名前缀
+         * @param[in] max_size 单个文件的最大字节数，0表示不按大小滚动
+         * @param[in] interval 按时间滚动的间隔(秒)，按本地时间对齐，0表示不按时间滚动
+         * @param[in] max_files 滚动时保留的文件个数(包括正在写的文件)，0表示全部保留
+         */
+        FileLogAppender(const std::string &filename, uint64_t max_size = 0, uint32_t interval = 0, uint32_t max_files = 0);
+
+        /**
+         * @brief 析构函数，写出缓冲并关闭文件
+         */
+        ~FileLogAppender();
+
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        std::string toYamlString() override;
+        void append(const char *data, size_t len) override;
+        bool supportsAppend() const override { return true; }
+        void flush() override;
+
+        /**
+         * @brief 重新打开日志文件
+         * @return 成功返回true
+         */
+        bool reopen();
+
+        /**
+         * @brief 返回正在写的文件路径
+         */
+        std::string getCurrentFile();
+
+        /**
+         * @brief 是否按大小或时间滚动
+         */
+        bool isRolling() const { return m_maxSize || m_interval; }
 
         /**
-         * @brief 设置主日志器
+         * @brief 设置持久化方式
+         * @param[in] mode 持久化方式
+         * @param[in] interval 后台fdatasync间隔(毫秒)，GROUP_COMMIT时为0表示只由日志触发，
+         *                     PERIODIC时为0表示每条日志都等待落盘(按GROUP_COMMIT、DEBUG级别处理)
+         * @param[in] level GROUP_COMMIT时需要等待落盘的最低级别
          */
-        void setRoot(Logger::ptr root) { m_root = root; }
+        void setDurability(Durability mode, uint32_t interval = 1000, LogLevel::Level level = LogLevel::ERROR);
+
+        /**
+         * @brief 返回持久化方式
+         */
+        Durability getDurability();
+
         /**
-         * @brief 获得主日志器
+         * @brief 写出缓冲并等待已写入的数据落盘
          */
-        Logger::ptr &getRoot() { return m_root; }
+        void sync();
 
     private:
-        /// 日志名称
-        std::string m_name;
-        /// 日志级别
-        LogLevel::Level m_level;
-        /// Mutex
-        // MutexType m_mutex;
-        /// 日志目标集合
-        std::list<LogAppender::ptr> m_appenders;
-        /// 日志格式器
-        LogFormatter::ptr m_formatter;
-        /// 主日志器
-        Logger::ptr m_root;
+        /// 缓冲大小，超过后写入文件
+        static const size_t kBufferSize = 64 * 1024;
+        /// 只按时间滚动时预分配的文件大小
+        static const uint64_t kPreallocSize = 64 * 1024 * 1024;
+
+        /**
+         * @brief 返回第index个滚动文件的路径
+         */
+        std::string segmentPath(uint64_t index) const;
+
+        /**
+         * @brief 打开并预分配第index个滚动文件
+         * @return 文件描述符，失败返回-1
+         */
+        int openSegment(uint64_t index) const;
+
+        /**
+         * @brief 计算now之后的下一个滚动时间(秒)
+         */
+        uint64_t nextRollTime(uint64_t now) const;
+
+        /**
+         * @brief 已有used字节的文件再写入len字节是否超过大小
+         */
+        bool isFull(uint64_t used, size_t len) const;
+
+        /**
+         * @brief 切换到下一个文件，缓冲中的数据会写入新文件，需持有m_mutex
+         * @return 打开新文件失败时返回false，继续写旧文件
+         */
+        bool roll(uint64_t now);
+
+        /**
+         * @brief 将缓冲的前len字节写入文件，需持有m_mutex
+         */
+        void writeBuffer(size_t len);
+
+        /**
+         * @brief 等待前target字节落盘，需持有m_mutex
+         * @details 没有正在进行的fdatasync时由当前线程写出缓冲并执行一次，覆盖之前写入的所有数据，
+         *          否则等待那一次完成后再判断，期间会释放锁
+         */
+        void commit(MutexType::Lock &lock, uint64_t target);
+
+        /**
+         * @brief 后台线程按间隔执行的fdatasync
+         */
+        void periodicSync();
+
+        /**
+         * @brief 后台线程的周期任务
+         */
+        void maintain();
+
+        /**
+         * @brief 删除超过保留个数的旧文件
+         */
+        void removeOldSegments(uint64_t current);
+
+    private:
+        /// 文件路径
+        std::string m_filename;
+        /// 单个文件的最大字节数
+        uint64_t m_maxSize;
+        /// 滚动间隔(秒)
+        uint32_t m_interval;
+        /// 保留的文件个数
+        uint32_t m_maxFiles;
+        /// 正在写的文件
+        int m_fd = -1;
+        /// 正在写的文件的序号，不滚动时为0
+        uint64_t m_index = 0;
+        /// 正在写的文件已写入的字节数
+        uint64_t m_size = 0;
+        /// 下次按时间滚动的时间(秒)
+        uint64_t m_rollTime = UINT64_MAX;
+        /// 预先打开的下一个文件，未准备好时为-1
+        int m_nextFd = -1;
+        /// 等待后台线程关闭的旧文件
+        std::vector<int> m_retired;
+        /// 写缓冲
+        std::string m_buffer;
+        /// 已清理过旧文件的序号，只在后台线程访问
+        uint64_t m_cleanedIndex = 0;
+        /// 后台任务id
+        uint64_t m_task = 0;
+        /// 持久化方式
+        Durability m_durability = NONE;
+        /// 组提交时需要等待落盘的最低级别
+        LogLevel::Level m_syncLevel = LogLevel::ERROR;
+        /// 已写入文件的总字节数
+        uint64_t m_written = 0;
+        /// 已落盘的总字节数
+        uint64_t m_synced = 0;
+        /// 是否有线程正在fdatasync
+        bool m_syncing = false;
+        /// 通知等待落盘的线程
+        std::condition_variable_any m_syncCond;
+        /// 后台fdatasync任务id
+        uint64_t m_syncTask = 0;
     };
 
     /**
-     * @brief 输出到控制台的Appender
+     * @brief 异步双缓冲Appender
+     * @details 前端线程把格式化后的日志追加到当前缓冲，缓冲写满后交给后台线程，
+     *          后台线程成批地将缓冲写入目标Appender（见LogAppender::append），
+     *          按flush间隔或析构时刷盘，调用线程不再承担磁盘I/O。
+     *          延迟格式化的事件(见LogEvent::defer)在前端只拷贝元数据和编码后的参数，由后台线程渲染。
+     *          等待写出的缓冲超过上限时按LogOverflowPolicy等待或丢弃
      */
-    class StdoutLogAppender : public LogAppender
+    class AsyncLogAppender : public LogAppender
     {
     public:
-        typedef std::shared_ptr<StdoutLogAppender> ptr;
+        typedef std::shared_ptr<AsyncLogAppender> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] target 实际写出数据的Appender
+         * @param[in] flush_interval 刷盘间隔(毫秒)
+         * @param[in] buffer_size 单个缓冲大小(字节)
+         * @param[in] max_buffers 最多等待后台写出的缓冲个数，超过时按LogOverflowPolicy处理，0表示不限制
+         * @exception std::invalid_argument target为空或不支持append()
+         */
+        AsyncLogAppender(LogAppender::ptr target, uint32_t flush_interval = 3000,
+                         size_t buffer_size = 4 * 1024 * 1024, size_t max_buffers = 16);
+
+        /**
+         * @brief 析构函数，写出所有缓冲后停止后台线程
+         */
+        ~AsyncLogAppender();
+
         void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
         std::string toYamlString() override;
+
+        /**
+         * @brief 把已格式化好的数据追加到当前缓冲，缓冲队列满时与log()一样按LogOverflowPolicy处理
+         * @details 数据不带日志级别，DROP_BELOW_LEVEL时按最低级别处理
+         */
+        void append(const char *data, size_t len) override;
+        bool supportsAppend() const override { return true; }
+
+        /**
+         * @brief 同步刷新，返回时之前写入的日志都已交给目标Appender并flush
+         */
+        void flush() override;
+
+        /**
+         * @brief 停止后台线程，剩余缓冲会先写出，之后的日志直接同步写入目标Appender
+         */
+        void stop();
+
+        /**
+         * @brief 返回等待后台写出的缓冲个数
+         */
+        size_t getQueueDepth() const { return m_queueDepth.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 返回刷盘间隔(毫秒)
+         */
+        uint32_t getFlushInterval() const { return m_flushInterval; }
+
+        /**
+         * @brief 设置刷盘间隔(毫秒)
+         */
+        void setFlushInterval(uint32_t val) { m_flushInterval = val; }
+
+        /**
+         * @brief 返回目标Appender
+         */
+        LogAppender::ptr getTarget() const { return m_target; }
+
+        /**
+         * @brief 设置缓冲队列满时的处理策略
+         */
+        void setOverflowPolicy(const LogOverflowPolicy &val);
+
+        /**
+         * @brief 返回缓冲队列满时的处理策略
+         */
+        LogOverflowPolicy getOverflowPolicy();
+
+        /**
+         * @brief 返回丢弃的日志条数
+         */
+        uint64_t getDroppedCount() const { return m_dropped.load(std::memory_order_relaxed); }
+
+    private:
+        /**
+         * @brief 等待后台渲染的延迟格式化日志
+         */
+        struct Deferred
+        {
+            /// 在Chunk::data中的插入位置
+            size_t offset;
+            /// 日志器，不延长日志器的生命周期
+            std::weak_ptr<Logger> logger;
+            LogLevel::Level level;
+            const char *filename;
+            int32_t line;
+            uint32_t elapse;
+            uint32_t threadId;
+            uint32_t fiberId;
+            uint64_t time;
+            const char *threadName;
+            const char *format;
+            /// 编码后的参数在Chunk::args中的起始位置，结构化字段紧随其后
+            size_t args;
+            size_t argsLen;
+            size_t fieldsLen;
+        };
+
+        /**
+         * @brief 一块缓冲
+         */
+        struct Chunk
+        {
+            /// 前端格式化好的日志
+            std::string data;
+            /// 延迟格式化日志的参数和结构化字段
+            std::string args;
+            /// 延迟格式化的日志，按插入位置排序
+            std::vector<Deferred> deferred;
+
+            size_t size() const { return data.size() + args.size() + deferred.size() * sizeof(Deferred); }
+            bool empty() const { return data.empty() && deferred.empty(); }
+
+            void clear()
+            {
+                data.clear();
+                args.clear();
+                deferred.clear();
+            }
+        };
+
+        typedef std::unique_ptr<Chunk> Buffer;
+
+        /**
+         * @brief 保证当前缓冲能放下len字节，放不下时交给后台线程并换一块，需持有m_queueMutex
+         * @return 可以写入当前缓冲时返回true；按策略丢弃或已经停止时返回false，由调用者根据m_running区分
+         */
+        bool reserve(std::unique_lock<std::mutex> &lock, const Logger::ptr &logger, LogLevel::Level level, size_t len);
+
+        /**
+         * @brief 缓冲队列满时等待或丢弃，需持有m_queueMutex
+         * @return 可以写入当前缓冲时返回true，这条日志被丢弃或等待期间已经停止时返回false
+         */
+        bool waitForSpace(std::unique_lock<std::mutex> &lock, const Logger::ptr &logger, LogLevel::Level level);
+
+        /**
+         * @brief 将丢弃条数作为一条日志写入目标Appender，只在后台线程调用
+         */
+        void reportDropped(bool force);
+
+        /**
+         * @brief 后台线程主循环
+         */
+        void backend();
+
+        /**
+         * @brief 渲染缓冲中的延迟格式化日志并写入目标Appender，只在后台线程调用
+         */
+        void write(Chunk &chunk);
+
+        /**
+         * @brief 取一块空缓冲，需持有m_queueMutex
+         */
+        Buffer takeBuffer();
+
+    private:
+        /// 目标Appender
+        LogAppender::ptr m_target;
+        /// 刷盘间隔(毫秒)
+        std::atomic<uint32_t> m_flushInterval;
+        /// 单个缓冲大小
+        size_t m_bufferSize;
+        /// 保护缓冲队列
+        std::mutex m_queueMutex;
+        /// 通知后台线程
+        std::condition_variable m_cond;
+        /// 通知flush调用者
+        std::condition_variable m_flushCond;
+        /// 当前写入的缓冲
+        Buffer m_current;
+        /// 写满等待后台写出的缓冲
+        std::vector<Buffer> m_buffers;
+        /// 后台写完归还的空缓冲
+        std::vector<Buffer> m_spares;
+        /// 等待写出的缓冲个数
+        std::atomic<size_t> m_queueDepth;
+        /// 最多等待写出的缓冲个数
+        size_t m_maxBuffers;
+        /// 缓冲队列满时的处理策略
+        LogOverflowPolicy m_policy;
+        /// 通知等待缓冲队列的线程
+        std::condition_variable m_spaceCond;
+        /// 丢弃的日志条数
+        std::atomic<uint64_t> m_dropped;
+        /// 最近一次丢弃日志的日志器，报告丢弃条数时使用；日志器持有本Appender，不能反过来持有日志器
+        std::weak_ptr<Logger> m_dropLogger;
+        /// 已报告的丢弃条数，只由后台线程访问
+        uint64_t m_reported = 0;
+        /// 下次可以报告的时间(纳秒)，只由后台线程访问
+        uint64_t m_nextReport = 0;
+        /// 已请求的flush序号
+        uint64_t m_flushRequested = 0;
+        /// 已完成的flush序号
+        uint64_t m_flushDone = 0;
+        /// 是否运行
+        bool m_running = false;
+        /// 后台线程
+        std::thread m_thread;
+        /// 后台线程渲染延迟格式化日志用的缓冲
+        std::string m_rendered;
     };
 
     /**
-     * @brief 输出到文件的Appender
+     * @brief 合并连续重复日志的Appender
+     * @details 调用点、级别、日志器和内容都相同的连续日志只把第一条格式化后交给目标Appender(见LogAppender::append)，之后的只计数，
+     *          出现不同的日志、flush或后台线程每秒检查时输出一条"last message repeated N times"汇总。
+     *          内容哈希在锁外计算，命中后再逐字节确认；汇总事件取自事件池，稳定状态下不分配内存
      */
-    class FileLogAppender : public LogAppender
+    class DedupLogAppender : public LogAppender
     {
     public:
-        typedef std::shared_ptr<FileLogAppender> ptr;
-        FileLogAppender(const std::string &filename);
+        typedef std::shared_ptr<DedupLogAppender> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] target 实际输出日志的Appender
+         * @exception std::invalid_argument target为空或不支持append()
+         */
+        DedupLogAppender(LogAppender::ptr target);
+
+        /**
+         * @brief 析构函数，输出未报告的重复次数
+         */
+        ~DedupLogAppender();
+
         void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
         std::string toYamlString() override;
+        void append(const char *data, size_t len) override;
+        bool supportsAppend() const override { return true; }
+        void flush() override;
 
         /**
-         * @brief 重新打开日志文件
-         * @return 成功返回true
+         * @brief 返回被合并掉的日志条数
          */
-        bool reopen();
+        uint64_t getSuppressedCount() const { return m_suppressed.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief 返回目标Appender
+         */
+        LogAppender::ptr getTarget() const { return m_target; }
 
     private:
-        /// 文件路径
-        std::string m_filename;
-        /// 文件流
-        std::ofstream m_filestream;
-        /// 上次重新打开时间
+        /**
+         * @brief 有未报告的重复时输出汇总，需持有m_mutex
+         * @param[out] holder 汇总用到的日志器。它可能是日志器的最后一个引用，日志器析构会析构本Appender，
+         *                    因此由调用方在释放m_mutex之后再释放
+         */
+        void emitSummary(Logger::ptr &holder);
+
+        /**
+         * @brief 是否与最近一条日志重复，需持有m_mutex
+         */
+        bool isRepeat(LogLevel::Level level, const LogEvent &event, uint64_t hash) const;
+
+        /**
+         * @brief 记住最近一条日志，需持有m_mutex
+         */
+        void remember(LogLevel::Level level, const LogEvent &event, uint64_t hash);
+
+        /**
+         * @brief 格式化后交给目标Appender，需持有m_mutex
+         */
+        void write(Logger *logger, LogLevel::Level level, const LogEvent &event);
+
+        /**
+         * @brief 后台线程的周期任务
+         */
+        void report();
+
+    private:
+        /// 目标Appender
+        LogAppender::ptr m_target;
+        /// 最近一条交给目标的日志的日志器，日志器持有本Appender，这里不能持有日志器或日志事件
+        std::weak_ptr<Logger> m_lastLogger;
+        /// 同上，只用于比较
+        const Logger *m_lastLoggerPtr = nullptr;
+        /// 最近一条日志的调用点
+        const LogSite *m_lastSite = nullptr;
+        /// 最近一条日志的文件名，没有调用点时使用
+        const char *m_lastFile = nullptr;
+        /// 最近一条日志的行号，没有调用点时使用
+        int32_t m_lastLine = 0;
+        /// 最近一条日志的延迟格式串
+        const char *m_lastDeferFormat = nullptr;
+        /// 最近一条日志的内容，重复使用同一块内存
+        std::string m_lastContent;
+        /// 最近一条日志的结构化字段
+        std::string m_lastFields;
+        /// 最近一条日志的线程id
+        uint32_t m_lastThreadId = 0;
+        /// 最近一条日志的线程名
+        const char *m_lastThreadName = "";
+        /// 最近一条日志的时间(纳秒)
         uint64_t m_lastTime = 0;
+        /// 最近一条日志的级别
+        LogLevel::Level m_lastLevel = LogLevel::UNKNOWN;
+        /// 最近一条日志的内容哈希
+        uint64_t m_lastHash = 0;
+        /// 未报告的重复次数
+        uint64_t m_repeats = 0;
+        /// 最后一次重复的时间(纳秒)
+        uint64_t m_lastRepeat = 0;
+        /// 被合并掉的日志条数
+        std::atomic<uint64_t> m_suppressed;
+        /// 后台任务id
+        uint64_t m_task = 0;
     };
 
     /**
      * @brief 日志器管理类
+     * @details 日志器按点分名称组成层级("net.http.client"的父日志器是"net.http")，
+     *          名称到日志器的开放寻址哈希表以RCU方式发布，查找不加锁；创建新日志器时原子地写入空槽，
+     *          只有负载超过一半需要扩容时才重建并替换整张表
      */
     class LoggerManager
     {
     public:
-        // typedef Spinlock MutexType;
+        typedef Mutex MutexType;
         /**
          * @brief 构造函数
          */
         LoggerManager();
 
         /**
-         * @brief 获取日志器
+         * @brief 获取日志器，不存在时连同缺少的祖先一起创建
          * @param[in] name 日志器名称
+         * @details 新建的日志器不设置级别，继承父日志器的级别和日志目标
          */
         Logger::ptr getLogger(const std::string &name);
 
@@ -603,11 +2342,86 @@ namespace tensir
          */
         std::string toYamlString();
 
+        /**
+         * @brief 一个日志器或日志目标的指标
+         */
+        struct MetricsEntry
+        {
+            /// 日志器名称，或"日志器名称/日志目标类型#序号"
+            std::string name;
+            /// 指标
+            LogMetrics::Snapshot metrics;
+        };
+
+        /**
+         * @brief 指标快照
+         */
+        struct MetricsReport
+        {
+            /// 所有日志器，按名称排序
+            std::vector<MetricsEntry> loggers;
+            /// 所有日志目标，被多个日志器共用的只出现一次，名称取第一个拥有它的日志器
+            std::vector<MetricsEntry> appenders;
+        };
+
+        /**
+         * @brief 汇总所有日志器和日志目标的指标
+         */
+        MetricsReport getMetrics();
+
+        /**
+         * @brief 返回JSON格式的指标快照
+         */
+        std::string getMetricsJson();
+
+    private:
+        /**
+         * @brief 一个日志器，创建后不再修改，直到LoggerManager析构
+         */
+        struct LoggerEntry
+        {
+            std::string name;
+            size_t hash;
+            Logger::ptr logger;
+        };
+
+        /**
+         * @brief 开放寻址的日志器哈希表
+         * @details 日志器只增不减，新日志器直接写入空槽，读者无锁查找；
+         *          装载因子超过一半时才换成两倍大小的新表，平摊后每次创建的开销与已有日志器个数无关
+         */
+        struct LoggerTable
+        {
+            explicit LoggerTable(size_t capacity);
+
+            /**
+             * @brief 查找日志器，可与insert并发
+             */
+            const LoggerEntry *find(const std::string &name, size_t hash) const;
+
+            /**
+             * @brief 写入到空槽，需持有m_mutex
+             */
+            void insert(const LoggerEntry *entry) const;
+
+            size_t capacity() const { return mask + 1; }
+
+            size_t mask;
+            std::unique_ptr<std::atomic<const LoggerEntry *>[]> slots;
+        };
+
+        /**
+         * @brief 查找或创建日志器，需持有m_mutex
+         */
+        Logger::ptr getOrCreate(const std::string &name, size_t hash);
+
     private:
-        /// Mutex
-        // MutexType m_mutex;
-        /// 日志器容器
-        std::map<std::string, Logger::ptr> m_loggers;
+        /// Mutex，串行化创建日志器
+        MutexType m_mutex;
+        /// 日志器哈希表，扩容时整体替换
+        RcuPtr<LoggerTable> m_loggers;
+        /// 所有日志器，按创建顺序，由m_mutex保护
+        std::vector<std::unique_ptr<const LoggerEntry>> m_entries;
         /// 主日志器
         Logger::ptr m_root;
     };
@@ -0,0 +1,280 @@
+#include "LogArgs.h"
+#include <stdio.h>
+
+namespace tensir
+{
+    bool LogArgs::Reader::next(Value &value)
+    {
+        if (m_cur >= m_end)
+        {
+            return false;
+        }
+        value.tag = (Tag)*m_cur++;
+        switch (value.tag)
+        {
+        case INT32:
+        case BOOL:
+        {
+            int32_t v;
+            if (!read(&v, sizeof(v)))
+                return false;
+            value.bits = (uint64_t)(int64_t)v;
+            return true;
+        }
+        case UINT32:
+        {
+            uint32_t v;
+            if (!read(&v, sizeof(v)))
+                return false;
+            value.bits = v;
+            return true;
+        }
+        case INT64:
+        case UINT64:
+        case POINTER:
+            return read(&value.bits, sizeof(value.bits));
+        case DOUBLE:
+            return read(&value.real, sizeof(value.real));
+        case STRING:
+            if (!read(&value.len, sizeof(value.len)) || (size_t)(m_end - m_cur) < (size_t)value.len + 1)
+            {
+                m_cur = m_end;
+                return false;
+            }
+            value.str = m_cur;
+            m_cur += value.len + 1;
+            return true;
+        default:
+            m_cur = m_end;
+            return false;
+        }
+    }
+
+    bool LogArgs::Reader::read(void *dst, size_t n)
+    {
+        if ((size_t)(m_end - m_cur) < n)
+        {
+            m_cur = m_end;
+            return false;
+        }
+        memcpy(dst, m_cur, n);
+        SwapToLittle((char *)dst, n);
+        m_cur += n;
+        return true;
+    }
+
+    namespace
+    {
+        bool IsIntegerTag(LogArgs::Tag tag)
+        {
+            return tag == LogArgs::INT32 || tag == LogArgs::UINT32 || tag == LogArgs::INT64 || tag == LogArgs::UINT64 ||
+                   tag == LogArgs::POINTER || tag == LogArgs::BOOL;
+        }
+
+        bool IsSignedTag(LogArgs::Tag tag)
+        {
+            return tag == LogArgs::INT32 || tag == LogArgs::INT64 || tag == LogArgs::BOOL;
+        }
+
+        /**
+         * @brief 整数参数按printf解释的位数，h、hh之外的长度修饰符不改变编码时的宽度
+         * @param[in] length 0表示无长度修饰符，'h'为h，'H'为hh，其余为'l'
+         */
+        unsigned IntegerWidth(LogArgs::Tag tag, char length)
+        {
+            if (length == 'H')
+            {
+                return 8;
+            }
+            if (length == 'h')
+            {
+                return 16;
+            }
+            return tag == LogArgs::INT64 || tag == LogArgs::UINT64 || tag == LogArgs::POINTER ? 64 : 32;
+        }
+
+        uint64_t ZeroExtend(uint64_t bits, unsigned width)
+        {
+            return width >= 64 ? bits : bits & ((1ull << width) - 1);
+        }
+
+        int64_t SignExtend(uint64_t bits, unsigned width)
+        {
+            if (width >= 64)
+            {
+                return (int64_t)bits;
+            }
+            uint64_t sign = 1ull << (width - 1);
+            return (int64_t)((ZeroExtend(bits, width) ^ sign) - sign);
+        }
+
+        /**
+         * @brief snprintf追加到out
+         */
+        template <class T>
+        void AppendSpec(std::string &out, const std::string &spec, T v)
+        {
+            size_t pos = out.size();
+            out.resize(pos + 64);
+            int n = snprintf(&out[pos], 64, spec.c_str(), v);
+            if (n < 0)
+            {
+                out.resize(pos);
+                return;
+            }
+            if (n >= 64)
+            {
+                out.resize(pos + n + 1);
+                snprintf(&out[pos], n + 1, spec.c_str(), v);
+            }
+            out.resize(pos + n);
+        }
+    }
+
+    void LogArgs::Render(std::string &out, const char *fmt, const char *data, size_t len)
+    {
+        Reader reader(data, len);
+        std::string spec;
+        const char *p = fmt;
+        while (*p)
+        {
+            const char *percent = strchr(p, '%');
+            if (!percent)
+            {
+                out.append(p);
+                break;
+            }
+            out.append(p, percent - p);
+            p = percent + 1;
+            if (*p == '%')
+            {
+                out.append(1, '%');
+                ++p;
+                continue;
+            }
+
+            // %[flags][width][.precision][length]conversion
+            spec.assign(1, '%');
+            bool missing = false;
+            while (*p && strchr("-+ #0", *p))
+            {
+                spec.append(1, *p++);
+            }
+            for (int part = 0; part < 2; ++part)
+            {
+                if (part == 1)
+                {
+                    if (*p != '.')
+                    {
+                        break;
+                    }
+                    spec.append(1, *p++);
+                }
+                if (*p == '*')
+                {
+                    ++p;
+                    Value value;
+                    if (reader.next(value) && IsIntegerTag(value.tag))
+                    {
+                        spec.append(std::to_string((int)(int64_t)value.bits));
+                    }
+                    else
+                    {
+                        missing = true;
+                    }
+                }
+                while (*p >= '0' && *p <= '9')
+                {
+                    spec.append(1, *p++);
+                }
+            }
+            char length = 0;
+            while (*p && strchr("hlLqjzt", *p))
+            {
+                length = *p == 'h' ? (length == 'h' ? 'H' : 'h') : 'l';
+                ++p;
+            }
+            char conv = *p;
+            if (!conv)
+            {
+                out.append(percent);
+                break;
+            }
+            ++p;
+            if (conv == 'n')
+            {
+                continue;
+            }
+
+            Value value;
+            if (missing || !reader.next(value))
+            {
+                out.append(percent, p - percent);
+                continue;
+            }
+            Tag tag = value.tag;
+            uint64_t bits = value.bits;
+            double real = value.real;
+            const char *str = value.str;
+            uint32_t slen = value.len;
+
+            // 字符串参数一律按%s输出，%s遇到数值参数按数值本身的类型输出
+            if (tag == STRING)
+            {
+                if (spec.size() == 1)
+                {
+                    out.append(str, slen);
+                }
+                else
+                {
+                    AppendSpec(out, spec + 's', str);
+                }
+                continue;
+            }
+            if (conv == 's')
+            {
+                conv = tag == DOUBLE ? 'g' : (tag == POINTER ? 'p' : (IsSignedTag(tag) ? 'd' : 'u'));
+            }
+
+            // 与printf一致，整数按参数的编码宽度(或h、hh)截断后再解释符号
+            unsigned width = IntegerWidth(tag, length);
+            switch (conv)
+            {
+            case 'd':
+            case 'i':
+                AppendSpec(out, spec + "ll" + conv, tag == DOUBLE ? (long long)real : (long long)SignExtend(bits, width));
+                break;
+            case 'u':
+            case 'o':
+            case 'x':
+            case 'X':
+                AppendSpec(out, spec + "ll" + conv,
+                           tag == DOUBLE ? (unsigned long long)real : (unsigned long long)ZeroExtend(bits, width));
+                break;
+            case 'c':
+                AppendSpec(out, spec + conv, tag == DOUBLE ? (int)real : (int)bits);
+                break;
+            case 'p':
+                AppendSpec(out, spec + conv, (void *)(uintptr_t)bits);
+                break;
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'a':
+            case 'A':
+                if (tag != DOUBLE)
+                {
+                    real = IsSignedTag(tag) ? (double)(int64_t)bits : (double)bits;
+                }
+                AppendSpec(out, spec + conv, real);
+                break;
+            default:
+                out.append(percent, p - percent);
+                break;
+            }
+        }
+    }
+}
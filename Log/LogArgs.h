@@ -0,0 +1,209 @@
+/**
+ * @file LogArgs.h
+ * @brief 延迟格式化的日志参数编码
+ * @author TenSir
+ * @date 2021年08月12日
+ * @copyright Copyright (c) 2021年
+ */
+#ifndef _TENSIR_LOGARGS_H
+#define _TENSIR_LOGARGS_H
+
+#include <string>
+#include <algorithm>
+#include <type_traits>
+#include <stdint.h>
+#include <string.h>
+#include "LogStream.h"
+
+namespace tensir
+{
+    /**
+     * @brief 日志参数的二进制编码
+     * @details 调用线程只把参数按类型写成 [类型标记][定长小端字节] 序列，字符串为uint32长度+内容+'\0'，
+     *          真正的printf式渲染由Render在后台线程或离线完成。编码自描述，不依赖调用方的模板实例，
+     *          因此二进制日志文件也可以直接解码。
+     *          LogDispatcher和AsyncLogAppender在后台线程渲染，BinaryLogAppender离线渲染，
+     *          其余同步Appender仍在调用线程渲染，只省去了编码之外的中间字符串
+     */
+    class LogArgs
+    {
+    public:
+        /**
+         * @brief 参数类型标记
+         */
+        enum Tag
+        {
+            INT32 = 1,
+            UINT32,
+            INT64,
+            UINT64,
+            DOUBLE,
+            POINTER,
+            /// uint32长度 + 内容 + '\0'
+            STRING,
+            /// 按INT32编码，用于区分结构化字段中的true/false
+            BOOL
+        };
+
+        /**
+         * @brief 解码出的一个参数
+         */
+        struct Value
+        {
+            Tag tag;
+            /// 整数、布尔和指针的值，有符号数按补码保存
+            uint64_t bits = 0;
+            /// 浮点数的值
+            double real = 0;
+            /// 字符串，以'\0'结尾
+            const char *str = nullptr;
+            /// 字符串长度
+            uint32_t len = 0;
+        };
+
+        /**
+         * @brief 解码游标
+         */
+        class Reader
+        {
+        public:
+            Reader(const char *data, size_t len) : m_cur(data), m_end(data + len) {}
+
+            /**
+             * @brief 读取下一个参数
+             * @return 没有参数或数据不完整时返回false
+             */
+            bool next(Value &value);
+
+        private:
+            bool read(void *dst, size_t n);
+
+        private:
+            const char *m_cur;
+            const char *m_end;
+        };
+
+        /**
+         * @brief 将参数编码后追加到out
+         * @param[in, out] out 输出，LogStream或std::string
+         */
+        template <class Out, class... Args>
+        static void Encode(Out &out, const Args &...args)
+        {
+            int dummy[] = {0, (Put(out, args), 0)...};
+            (void)dummy;
+        }
+
+        /**
+         * @brief 按printf格式渲染编码后的参数，结果追加到out
+         * @param[in, out] out 输出
+         * @param[in] fmt printf格式串
+         * @param[in] data 编码后的参数
+         * @param[in] len 编码后的参数长度
+         * @details 整数按实际编码的宽度(32或64位)解释，h、hh再截断到16、8位，其余长度修饰符以编码的类型为准，
+         *          结果与printf一致；%n被忽略，缺少的参数原样输出格式说明
+         */
+        static void Render(std::string &out, const char *fmt, const char *data, size_t len);
+
+    private:
+        /**
+         * @brief 编码中的数值固定为小端，大端机器上翻转字节序，编码和解码共用
+         */
+        static void SwapToLittle(char *data, size_t len)
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            std::reverse(data, data + len);
+#else
+            (void)data;
+            (void)len;
+#endif
+        }
+
+        template <class Out, class T>
+        static void PutRaw(Out &out, Tag tag, T v)
+        {
+            char buf[1 + sizeof(T)];
+            buf[0] = (char)tag;
+            memcpy(buf + 1, &v, sizeof(T));
+            SwapToLittle(buf + 1, sizeof(T));
+            out.append(buf, sizeof(buf));
+        }
+
+        template <class Out>
+        static void PutString(Out &out, const char *str, size_t len)
+        {
+            uint32_t n = len;
+            char buf[1 + sizeof(n)];
+            buf[0] = (char)STRING;
+            memcpy(buf + 1, &n, sizeof(n));
+            SwapToLittle(buf + 1, sizeof(n));
+            out.append(buf, sizeof(buf));
+            out.append(str, len);
+            out.append("", 1);
+        }
+
+        template <class Out>
+        static void Put(Out &out, bool v) { PutRaw(out, BOOL, (int32_t)v); }
+        template <class Out>
+        static void Put(Out &out, char v) { PutRaw(out, INT32, (int32_t)v); }
+        template <class Out>
+        static void Put(Out &out, signed char v) { PutRaw(out, INT32, (int32_t)v); }
+        template <class Out>
+        static void Put(Out &out, unsigned char v) { PutRaw(out, UINT32, (uint32_t)v); }
+        template <class Out>
+        static void Put(Out &out, short v) { PutRaw(out, INT32, (int32_t)v); }
+        template <class Out>
+        static void Put(Out &out, unsigned short v) { PutRaw(out, UINT32, (uint32_t)v); }
+        template <class Out>
+        static void Put(Out &out, int v) { PutRaw(out, INT32, (int32_t)v); }
+        template <class Out>
+        static void Put(Out &out, unsigned int v) { PutRaw(out, UINT32, (uint32_t)v); }
+        template <class Out>
+        static void Put(Out &out, long v) { PutRaw(out, INT64, (int64_t)v); }
+        template <class Out>
+        static void Put(Out &out, unsigned long v) { PutRaw(out, UINT64, (uint64_t)v); }
+        template <class Out>
+        static void Put(Out &out, long long v) { PutRaw(out, INT64, (int64_t)v); }
+        template <class Out>
+        static void Put(Out &out, unsigned long long v) { PutRaw(out, UINT64, (uint64_t)v); }
+        template <class Out>
+        static void Put(Out &out, float v) { PutRaw(out, DOUBLE, (double)v); }
+        template <class Out>
+        static void Put(Out &out, double v) { PutRaw(out, DOUBLE, v); }
+        template <class Out>
+        static void Put(Out &out, long double v) { PutRaw(out, DOUBLE, (double)v); }
+        template <class Out>
+        static void Put(Out &out, const std::string &v) { PutString(out, v.data(), v.size()); }
+
+        template <class Out>
+        static void Put(Out &out, const char *v)
+        {
+            if (v)
+            {
+                PutString(out, v, strlen(v));
+            }
+            else
+            {
+                PutString(out, "(null)", 6);
+            }
+        }
+
+        template <class Out>
+        static void Put(Out &out, char *v) { Put(out, (const char *)v); }
+
+        template <class Out, class T>
+        static void Put(Out &out, T *v) { PutRaw(out, POINTER, (uint64_t)(uintptr_t)v); }
+
+        /**
+         * @brief 枚举按整数编码，其他类型编译期报错
+         */
+        template <class Out, class T>
+        static void Put(Out &out, const T &v)
+        {
+            static_assert(std::is_enum<T>::value, "unsupported deferred log argument type");
+            PutRaw(out, INT64, (int64_t)v);
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include "LogBinary.h"
+#include <string.h>
+
+namespace tensir
+{
+    namespace
+    {
+        void PutVarint(std::string &out, uint64_t v)
+        {
+            while (v >= 0x80)
+            {
+                out.push_back((char)(v | 0x80));
+                v >>= 7;
+            }
+            out.push_back((char)v);
+        }
+
+        void PutString(std::string &out, const char *str, size_t len)
+        {
+            PutVarint(out, len);
+            out.append(str, len);
+        }
+
+        void PutString(std::string &out, const char *str)
+        {
+            PutString(out, str ? str : "", str ? strlen(str) : 0);
+        }
+
+        uint64_t ZigZag(int64_t v)
+        {
+            return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+        }
+
+        int64_t UnZigZag(uint64_t v)
+        {
+            return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+        }
+    }
+
+    const char BinaryLogAppender::kMagic[4] = {'T', 'S', 'L', 'G'};
+
+    BinaryLogAppender::BinaryLogAppender(const std::string &filename)
+        : m_filename(filename)
+    {
+        m_filestream.open(m_filename.c_str(), std::ios::app | std::ios::binary);
+        // 追加写时也写文件头，读取端遇到文件头会清空字典重新开始
+        m_filestream.write(kMagic, sizeof(kMagic));
+        m_filestream.put((char)kVersion);
+    }
+
+    uint64_t BinaryLogAppender::siteId(const Logger *logger, LogLevel::Level level, const LogEvent &event)
+    {
+        SiteKey key = {event.getFilename(), event.getLine(), level, logger, event.getDeferFormat()};
+        auto it = m_sites.find(key);
+        if (it != m_sites.end())
+        {
+            return it->second;
+        }
+
+        uint64_t id = m_sites.size() + 1;
+        m_sites[key] = id;
+        m_buffer.push_back((char)RECORD_SITE);
+        PutVarint(m_buffer, id);
+        PutVarint(m_buffer, ZigZag(event.getLine()));
+        PutVarint(m_buffer, level);
+        PutString(m_buffer, event.getFilename());
+        PutString(m_buffer, logger->getName().data(), logger->getName().size());
+        PutString(m_buffer, event.getDeferFormat());
+        return id;
+    }
+
+    uint64_t BinaryLogAppender::threadId(const char *name)
+    {
+        auto it = m_threads.find(name);
+        if (it != m_threads.end())
+        {
+            return it->second;
+        }
+
+        uint64_t id = m_threads.size() + 1;
+        m_threads[name] = id;
+        m_buffer.push_back((char)RECORD_THREAD);
+        PutVarint(m_buffer, id);
+        PutString(m_buffer, name, strlen(name));
+        return id;
+    }
+
+    void BinaryLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level < getLevel())
+        {
+            return;
+        }
+
+        const Logger *l = event->getLogger() ? event->getLogger().get() : logger.get();
+        MutexType::Lock lock(m_mutex);
+        m_buffer.clear();
+        uint64_t site = siteId(l, level, *event);
+        uint64_t thread = threadId(event->getThreadName());
+
+        m_buffer.push_back((char)RECORD_EVENT);
+        PutVarint(m_buffer, site);
+        PutVarint(m_buffer, ZigZag((int64_t)(event->getTimestamp() - m_lastTime)));
+        m_lastTime = event->getTimestamp();
+        PutVarint(m_buffer, event->getThreadId());
+        PutVarint(m_buffer, event->getFiberId());
+        PutVarint(m_buffer, event->getElapse());
+        PutVarint(m_buffer, thread);
+        m_buffer.push_back((char)(event->isDeferred() ? CONTENT_ARGS : CONTENT_TEXT));
+        PutString(m_buffer, event->getSS().data(), event->getSS().size());
+        m_filestream.write(m_buffer.data(), m_buffer.size());
+        addWritten(m_buffer.size());
+    }
+
+    std::string BinaryLogAppender::toYamlString()
+    {
+        // YAML::Node node;
+        // node["type"] = "BinaryLogAppender";
+        // node["file"] = m_filename;
+        return "";
+    }
+
+    void BinaryLogAppender::flush()
+    {
+        MutexType::Lock lock(m_mutex);
+        m_filestream.flush();
+    }
+
+    BinaryLogReader::BinaryLogReader(const std::string &filename)
+    {
+        m_filestream.open(filename.c_str(), std::ios::binary);
+        char magic[sizeof(BinaryLogAppender::kMagic)];
+        if (m_filestream.read(magic, sizeof(magic)) && memcmp(magic, BinaryLogAppender::kMagic, sizeof(magic)) == 0 && m_filestream.get() == BinaryLogAppender::kVersion)
+        {
+            m_ok = true;
+        }
+    }
+
+    bool BinaryLogReader::readVarint(uint64_t &v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            int c = m_filestream.get();
+            if (c == EOF)
+            {
+                return false;
+            }
+            v |= (uint64_t)(c & 0x7f) << shift;
+            if (!(c & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool BinaryLogReader::readString(std::string &str)
+    {
+        uint64_t len;
+        if (!readVarint(len) || len > (64u << 20))
+        {
+            return false;
+        }
+        str.resize(len);
+        return len == 0 || m_filestream.read(&str[0], len);
+    }
+
+    LogEvent::ptr BinaryLogReader::next(LogLevel::Level &level)
+    {
+        while (m_ok)
+        {
+            int type = m_filestream.get();
+            if (type == EOF)
+            {
+                return nullptr;
+            }
+
+            if (type == BinaryLogAppender::kMagic[0])
+            {
+                char magic[sizeof(BinaryLogAppender::kMagic)];
+                magic[0] = type;
+                if (!m_filestream.read(magic + 1, sizeof(magic) - 1) || memcmp(magic, BinaryLogAppender::kMagic, sizeof(magic)) != 0 || m_filestream.get() != BinaryLogAppender::kVersion)
+                {
+                    break;
+                }
+                m_sites.clear();
+                m_threads.clear();
+                m_lastTime = 0;
+            }
+            else if (type == BinaryLogAppender::RECORD_SITE)
+            {
+                uint64_t id, line, lv;
+                Site site;
+                std::string name;
+                if (!readVarint(id) || !readVarint(line) || !readVarint(lv) || !readString(site.filename) || !readString(name) || !readString(site.format))
+                {
+                    break;
+                }
+                site.line = (int32_t)UnZigZag(line);
+                site.level = (LogLevel::Level)lv;
+                Logger::ptr &logger = m_loggers[name];
+                if (!logger)
+                {
+                    logger.reset(new Logger(name));
+                }
+                site.logger = logger;
+                m_sites[id] = site;
+            }
+            else if (type == BinaryLogAppender::RECORD_THREAD)
+            {
+                uint64_t id;
+                std::string name;
+                if (!readVarint(id) || !readString(name))
+                {
+                    break;
+                }
+                m_threads[id] = LogThread::Intern(name.c_str());
+            }
+            else if (type == BinaryLogAppender::RECORD_EVENT)
+            {
+                uint64_t site_id, delta, thread_id, fiber_id, elapse, name_id;
+                int content_type;
+                if (!readVarint(site_id) || !readVarint(delta) || !readVarint(thread_id) || !readVarint(fiber_id) || !readVarint(elapse) || !readVarint(name_id) || (content_type = m_filestream.get()) == EOF || !readString(m_content))
+                {
+                    break;
+                }
+                auto site = m_sites.find(site_id);
+                if (site == m_sites.end())
+                {
+                    break;
+                }
+                m_lastTime += UnZigZag(delta);
+                auto name = m_threads.find(name_id);
+                LogEvent::ptr event = LogEvent::Create(site->second.logger, site->second.level,
+                                                       site->second.filename.c_str(), site->second.line,
+                                                       elapse, thread_id, fiber_id, m_lastTime,
+                                                       name == m_threads.end() ? "" : name->second);
+                if (content_type == BinaryLogAppender::CONTENT_ARGS)
+                {
+                    event->setDeferred(site->second.format.c_str(), m_content.data(), m_content.size());
+                }
+                else
+                {
+                    event->getSS().append(m_content.data(), m_content.size());
+                }
+                level = site->second.level;
+                return event;
+            }
+            else
+            {
+                break;
+            }
+        }
+        m_ok = false;
+        return nullptr;
+    }
+}
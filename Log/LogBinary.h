@@ -0,0 +1,177 @@
+/**
+ * @file LogBinary.h
+ * @brief 二进制日志文件
+ * @author TenSir
+ * @date 2021年08月12日
+ * @copyright Copyright (c) 2021年
+ * @details 文件格式(记录中的整数均为varint，每字节7位、低位在前，字符串为varint长度+内容)：
+ *          文件头  "TSLG" u8版本号
+ *          站点    u8(1) id 行号 级别 文件名 日志器名称 格式串(流式日志为空)
+ *          线程名  u8(2) id 线程名称
+ *          事件    u8(3) 站点id 时间差(zigzag，纳秒) 线程id 协程id 耗时 线程名id u8内容类型 内容
+ *          内容为CONTENT_TEXT时是文本，为CONTENT_ARGS时是LogArgs编码的参数，其中的数值是定长小端而不是varint。
+ *          同一调用点的静态信息只在第一次出现时写一次，事件中只有站点id、时间差和参数。
+ *          结构化字段(见LogEvent::with)不写入文件
+ */
+#ifndef _TENSIR_LOGBINARY_H
+#define _TENSIR_LOGBINARY_H
+
+#include "Log.h"
+#include <unordered_map>
+
+namespace tensir
+{
+    /**
+     * @brief 输出二进制日志的Appender，用log_decoder还原成文本
+     * @details 只能直接挂在日志器上同步写入(或经LogDispatcher)：它需要完整的日志事件，不接收格式化好的文本，
+     *          不实现append()，作为AsyncLogAppender或DedupLogAppender的目标时构造函数抛出std::invalid_argument
+     */
+    class BinaryLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<BinaryLogAppender> ptr;
+
+        /// 文件头魔数
+        static const char kMagic[4];
+        /// 格式版本
+        static const uint8_t kVersion = 1;
+
+        /// 记录类型
+        enum RecordType
+        {
+            RECORD_SITE = 1,
+            RECORD_THREAD = 2,
+            RECORD_EVENT = 3
+        };
+
+        /// 内容类型
+        enum ContentType
+        {
+            /// 已经生成的文本
+            CONTENT_TEXT = 0,
+            /// LogArgs编码的参数
+            CONTENT_ARGS = 1
+        };
+
+        /**
+         * @brief 构造函数
+         * @param[in] filename 文件路径，已存在时追加，新文件写入文件头
+         */
+        BinaryLogAppender(const std::string &filename);
+
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        std::string toYamlString() override;
+        void flush() override;
+
+    private:
+        /**
+         * @brief 调用点的静态信息
+         */
+        struct SiteKey
+        {
+            const char *filename;
+            int32_t line;
+            LogLevel::Level level;
+            const Logger *logger;
+            const char *format;
+
+            bool operator==(const SiteKey &o) const
+            {
+                return filename == o.filename && line == o.line && level == o.level && logger == o.logger && format == o.format;
+            }
+        };
+
+        struct SiteKeyHash
+        {
+            size_t operator()(const SiteKey &k) const
+            {
+                size_t h = std::hash<const void *>()(k.filename);
+                h = h * 31 + k.line;
+                h = h * 31 + k.level;
+                h = h * 31 + std::hash<const void *>()(k.logger);
+                h = h * 31 + std::hash<const void *>()(k.format);
+                return h;
+            }
+        };
+
+        /**
+         * @brief 返回调用点id，第一次出现时写入站点记录
+         */
+        uint64_t siteId(const Logger *logger, LogLevel::Level level, const LogEvent &event);
+
+        /**
+         * @brief 返回线程名id，第一次出现时写入线程名记录，线程名按指针区分
+         */
+        uint64_t threadId(const char *name);
+
+    private:
+        /// 文件路径
+        std::string m_filename;
+        /// 文件流，和字典一起由m_mutex保护
+        std::ofstream m_filestream;
+        /// 编码缓冲
+        std::string m_buffer;
+        /// 已经写入的调用点
+        std::unordered_map<SiteKey, uint64_t, SiteKeyHash> m_sites;
+        /// 已经写入的线程名，按驻留后的指针查找
+        std::unordered_map<const char *, uint64_t> m_threads;
+        /// 上一条事件的时间戳
+        uint64_t m_lastTime = 0;
+    };
+
+    /**
+     * @brief 二进制日志读取
+     */
+    class BinaryLogReader
+    {
+    public:
+        /**
+         * @brief 构造函数
+         * @param[in] filename 文件路径
+         */
+        BinaryLogReader(const std::string &filename);
+
+        /**
+         * @brief 文件是否打开且文件头正确
+         */
+        bool isOpen() const { return m_ok; }
+
+        /**
+         * @brief 读取下一条日志事件
+         * @param[out] level 日志级别
+         * @return 文件结束或数据损坏时返回nullptr
+         */
+        LogEvent::ptr next(LogLevel::Level &level);
+
+    private:
+        struct Site
+        {
+            std::string filename;
+            int32_t line;
+            LogLevel::Level level;
+            Logger::ptr logger;
+            std::string format;
+        };
+
+        bool readVarint(uint64_t &v);
+        bool readString(std::string &str);
+
+    private:
+        /// 文件流
+        std::ifstream m_filestream;
+        /// 文件头是否正确
+        bool m_ok = false;
+        /// 调用点字典
+        std::unordered_map<uint64_t, Site> m_sites;
+        /// 线程名字典，值为驻留后的线程名
+        std::unordered_map<uint64_t, const char *> m_threads;
+        /// 按名称复用的日志器
+        std::map<std::string, Logger::ptr> m_loggers;
+        /// 内容缓冲
+        std::string m_content;
+        /// 上一条事件的时间戳
+        uint64_t m_lastTime = 0;
+    };
+}
+
+#endif
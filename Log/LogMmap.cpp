@@ -0,0 +1,168 @@
+#include "LogMmap.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace tensir
+{
+    namespace
+    {
+        size_t PageSize()
+        {
+            static const size_t s_size = sysconf(_SC_PAGESIZE);
+            return s_size;
+        }
+    }
+
+    MmapLogAppender::MmapLogAppender(const std::string &filename, size_t map_size)
+        : m_filename(filename)
+    {
+        size_t page = PageSize();
+        m_mapSize = std::max(page, (map_size + page - 1) / page * page);
+        m_fd = ::open(m_filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (m_fd < 0)
+        {
+            return;
+        }
+        struct stat st;
+        if (fstat(m_fd, &st) == 0)
+        {
+            m_fileSize = st.st_size;
+            // 上次没有正常关闭时文件末尾是预分配的0
+            m_tail = recoverTail(m_fileSize);
+        }
+    }
+
+    MmapLogAppender::~MmapLogAppender()
+    {
+        if (m_base)
+        {
+            munmap(m_base, m_mapLen);
+        }
+        if (m_fd >= 0)
+        {
+            if (m_fileSize > m_tail)
+            {
+                int ret = ftruncate(m_fd, m_tail);
+                (void)ret;
+            }
+            ::close(m_fd);
+        }
+    }
+
+    uint64_t MmapLogAppender::recoverTail(uint64_t size)
+    {
+        char buf[64 * 1024];
+        uint64_t end = size;
+        while (end > 0)
+        {
+            size_t len = std::min<uint64_t>(end, sizeof(buf));
+            ssize_t n = pread(m_fd, buf, len, end - len);
+            if (n != (ssize_t)len)
+            {
+                return size;
+            }
+            for (size_t i = len; i > 0; --i)
+            {
+                if (buf[i - 1] != '\0')
+                {
+                    return end - len + i;
+                }
+            }
+            end -= len;
+        }
+        return 0;
+    }
+
+    void MmapLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level >= getLevel())
+        {
+            MutexType::Lock lock(m_mutex);
+            m_buffer.clear();
+            formatEvent(*m_formatter, m_buffer, logger.get(), level, *event);
+            write(m_buffer.data(), m_buffer.size());
+        }
+    }
+
+    std::string MmapLogAppender::toYamlString()
+    {
+        // YAML::Node node;
+        // node["type"] = "MmapLogAppender";
+        // node["file"] = m_filename;
+        return "";
+    }
+
+    void MmapLogAppender::append(const char *data, size_t len)
+    {
+        addWritten(len);
+        MutexType::Lock lock(m_mutex);
+        write(data, len);
+    }
+
+    void MmapLogAppender::flush()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (m_base)
+        {
+            msync(m_base, m_mapLen, MS_ASYNC);
+        }
+    }
+
+    uint64_t MmapLogAppender::getTail()
+    {
+        MutexType::Lock lock(m_mutex);
+        return m_tail;
+    }
+
+    void MmapLogAppender::write(const char *data, size_t len)
+    {
+        if (!len || m_fd < 0)
+        {
+            return;
+        }
+        if (m_tail + len > m_mapOffset + m_mapLen && !remap(len))
+        {
+            return;
+        }
+        memcpy(m_base + (m_tail - m_mapOffset), data, len);
+        m_tail += len;
+    }
+
+    bool MmapLogAppender::remap(size_t len)
+    {
+        if (m_base)
+        {
+            munmap(m_base, m_mapLen);
+            m_base = nullptr;
+            m_mapLen = 0;
+        }
+
+        size_t page = PageSize();
+        uint64_t offset = m_tail / page * page;
+        size_t size = std::max(m_mapSize, (size_t)((m_tail - offset + len + page - 1) / page * page));
+        uint64_t need = offset + size;
+        if (need > m_fileSize)
+        {
+            // 真正分配磁盘块，磁盘满时在这里失败，而不是写映射时收到SIGBUS；不支持时退化为稀疏文件
+            if (fallocate(m_fd, 0, m_fileSize, need - m_fileSize) != 0 &&
+                (errno != EOPNOTSUPP || ftruncate(m_fd, need) != 0))
+            {
+                return false;
+            }
+            m_fileSize = need;
+        }
+
+        void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, offset);
+        if (base == MAP_FAILED)
+        {
+            return false;
+        }
+        m_base = (char *)base;
+        m_mapOffset = offset;
+        m_mapLen = size;
+        return true;
+    }
+}
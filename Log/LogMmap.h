@@ -0,0 +1,97 @@
+/**
+ * @file LogMmap.h
+ * @brief 内存映射文件日志
+ * @author TenSir
+ * @date 2021年08月12日
+ * @copyright Copyright (c) 2021年
+ */
+#ifndef _TENSIR_LOGMMAP_H
+#define _TENSIR_LOGMMAP_H
+
+#include "Log.h"
+
+namespace tensir
+{
+    /**
+     * @brief 写入内存映射文件的Appender
+     * @details 文件按映射窗口大小用fallocate预先扩展(新空间全为0)，日志直接拷贝到MAP_SHARED映射中的写入位置，
+     *          每条日志不需要write系统调用，由内核回写到磁盘。数据拷贝进映射后就在页缓存中，进程崩溃也不会丢失。
+     *          重新打开时从文件末尾向前跳过为0的字节找到写入位置继续追加，正常关闭时截掉末尾没有用到的部分
+     */
+    class MmapLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<MmapLogAppender> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] filename 文件路径，已存在时追加
+         * @param[in] map_size 映射窗口大小(字节)，也是文件每次扩展的大小
+         */
+        MmapLogAppender(const std::string &filename, size_t map_size = 16 * 1024 * 1024);
+
+        /**
+         * @brief 析构函数，截掉末尾预分配的部分并关闭文件
+         */
+        ~MmapLogAppender();
+
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        std::string toYamlString() override;
+        void append(const char *data, size_t len) override;
+        bool supportsAppend() const override { return true; }
+
+        /**
+         * @brief 让内核开始回写已写入的数据，不等待完成
+         */
+        void flush() override;
+
+        /**
+         * @brief 文件是否打开成功
+         */
+        bool isOpen() const { return m_fd >= 0; }
+
+        /**
+         * @brief 返回写入位置(文件中有效数据的长度)
+         */
+        uint64_t getTail();
+
+    private:
+        /**
+         * @brief 写入数据，需持有m_mutex
+         */
+        void write(const char *data, size_t len);
+
+        /**
+         * @brief 映射从写入位置开始至少len字节的窗口，需要时扩展文件，需持有m_mutex
+         * @return 失败返回false
+         */
+        bool remap(size_t len);
+
+        /**
+         * @brief 从文件末尾向前找到最后一个非0字节之后的位置
+         */
+        uint64_t recoverTail(uint64_t size);
+
+    private:
+        /// 文件路径
+        std::string m_filename;
+        /// 映射窗口大小
+        size_t m_mapSize;
+        /// 文件描述符
+        int m_fd = -1;
+        /// 文件大小(包括预分配的部分)
+        uint64_t m_fileSize = 0;
+        /// 写入位置
+        uint64_t m_tail = 0;
+        /// 映射窗口
+        char *m_base = nullptr;
+        /// 映射窗口在文件中的偏移
+        uint64_t m_mapOffset = 0;
+        /// 映射窗口长度
+        size_t m_mapLen = 0;
+        /// 格式化缓冲
+        std::string m_buffer;
+    };
+}
+
+#endif
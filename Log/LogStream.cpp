@@ -0,0 +1,434 @@
+#include "LogStream.h"
+#include <stdio.h>
+#include <algorithm>
+
+namespace tensir
+{
+    namespace
+    {
+        const char kDigitPairs[] =
+            "00010203040506070809"
+            "10111213141516171819"
+            "20212223242526272829"
+            "30313233343536373839"
+            "40414243444546474849"
+            "50515253545556575859"
+            "60616263646566676869"
+            "70717273747576777879"
+            "80818283848586878889"
+            "90919293949596979899";
+
+        /**
+         * @brief 无符号整数转十进制，从buf尾部往前写，返回起始位置
+         */
+        char *ConvertUInt(char *end, unsigned long long v)
+        {
+            char *p = end;
+            while (v >= 100)
+            {
+                unsigned idx = (v % 100) * 2;
+                v /= 100;
+                *--p = kDigitPairs[idx + 1];
+                *--p = kDigitPairs[idx];
+            }
+            if (v >= 10)
+            {
+                unsigned idx = v * 2;
+                *--p = kDigitPairs[idx + 1];
+                *--p = kDigitPairs[idx];
+            }
+            else
+            {
+                *--p = '0' + v;
+            }
+            return p;
+        }
+
+        /**
+         * @brief 把std::ostream的输出直接写进LogStream
+         */
+        class LogStreamBuf : public std::streambuf
+        {
+        public:
+            LogStream *target = nullptr;
+
+        protected:
+            int_type overflow(int_type ch) override
+            {
+                if (ch != traits_type::eof())
+                {
+                    char c = ch;
+                    target->append(&c, 1);
+                }
+                return ch;
+            }
+
+            std::streamsize xsputn(const char *s, std::streamsize n) override
+            {
+                target->append(s, n);
+                return n;
+            }
+        };
+
+
+        /// 当前线程的线程局部流是否已析构
+        thread_local bool t_fallbackDestroyed = false;
+    }
+
+    struct LogStream::FallbackStream
+    {
+        LogStreamBuf buf;
+        std::ostream os;
+        /// 是否为线程局部的流
+        bool local;
+
+        FallbackStream(bool is_local) : os(&buf), local(is_local) {}
+
+        ~FallbackStream()
+        {
+            if (local)
+            {
+                t_fallbackDestroyed = true;
+            }
+        }
+    };
+
+    const char LogStream::kTruncatedMarker[] = "...(truncated)";
+    const std::streamsize LogStream::kDefaultPrecision;
+
+    LogStream::LogStream()
+        : m_data(m_inline),
+          m_cur(m_inline),
+          m_end(m_inline + kInlineSize)
+    {
+    }
+
+    LogStream::~LogStream()
+    {
+        if (m_data != m_inline)
+        {
+            delete[] m_data;
+        }
+    }
+
+    template <class T>
+    void LogStream::appendInteger(T v)
+    {
+        if (m_formatted)
+        {
+            formatted(v);
+            return;
+        }
+        char buf[32];
+        char *end = buf + sizeof(buf);
+        char *p;
+        if (v < 0)
+        {
+            p = ConvertUInt(end, 0ull - (unsigned long long)v);
+            *--p = '-';
+        }
+        else
+        {
+            p = ConvertUInt(end, (unsigned long long)v);
+        }
+        append(p, end - p);
+    }
+
+    LogStream &LogStream::operator<<(bool v)
+    {
+        if (m_formatted)
+        {
+            return formatted(v);
+        }
+        if (v)
+        {
+            append("1", 1);
+        }
+        else
+        {
+            append("0", 1);
+        }
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(char v)
+    {
+        if (m_formatted)
+        {
+            return formatted(v);
+        }
+        append(&v, 1);
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(signed char v)
+    {
+        return operator<<((char)v);
+    }
+
+    LogStream &LogStream::operator<<(unsigned char v)
+    {
+        return operator<<((char)v);
+    }
+
+#define XX(type)                                    \
+    LogStream &LogStream::operator<<(type v)        \
+    {                                               \
+        appendInteger(v);                           \
+        return *this;                               \
+    }
+
+    XX(short);
+    XX(unsigned short);
+    XX(int);
+    XX(unsigned int);
+    XX(long);
+    XX(unsigned long);
+    XX(long long);
+    XX(unsigned long long);
+#undef XX
+
+    LogStream &LogStream::operator<<(float v)
+    {
+        if (m_formatted)
+        {
+            return formatted(v);
+        }
+        appendf("%g", (double)v);
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(double v)
+    {
+        if (m_formatted)
+        {
+            return formatted(v);
+        }
+        appendf("%g", v);
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(long double v)
+    {
+        if (m_formatted)
+        {
+            return formatted(v);
+        }
+        appendf("%Lg", v);
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(const void *v)
+    {
+        if (m_formatted)
+        {
+            return formatted(v);
+        }
+        static const char kHex[] = "0123456789abcdef";
+        char buf[2 + sizeof(uintptr_t) * 2];
+        char *end = buf + sizeof(buf);
+        char *p = end;
+        uintptr_t i = (uintptr_t)v;
+        do
+        {
+            *--p = kHex[i & 0xf];
+            i >>= 4;
+        } while (i);
+        *--p = 'x';
+        *--p = '0';
+        append(p, end - p);
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(const char *v)
+    {
+        if (!v)
+        {
+            v = "(null)";
+        }
+        if (m_formatted)
+        {
+            return formatted(v);
+        }
+        append(v, strlen(v));
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(const std::string &v)
+    {
+        if (m_formatted)
+        {
+            return formatted(v);
+        }
+        append(v.data(), v.size());
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(std::ostream &(*manip)(std::ostream &))
+    {
+        Fallback fallback(*this);
+        manip(fallback.os());
+        return *this;
+    }
+
+    LogStream &LogStream::operator<<(std::ios_base &(*manip)(std::ios_base &))
+    {
+        Fallback fallback(*this);
+        manip(fallback.os());
+        return *this;
+    }
+
+    void LogStream::appendf(const char *fmt, ...)
+    {
+        va_list al;
+        va_start(al, fmt);
+        appendv(fmt, al);
+        va_end(al);
+    }
+
+    void LogStream::appendv(const char *fmt, va_list al)
+    {
+        va_list copy;
+        va_copy(copy, al);
+        size_t avail = m_end - m_cur;
+        int n = vsnprintf(m_cur, avail, fmt, al);
+        if (n >= 0)
+        {
+            if ((size_t)n < avail)
+            {
+                m_cur += n;
+            }
+            else if (grow(n + 1))
+            {
+                vsnprintf(m_cur, n + 1, fmt, copy);
+                m_cur += n;
+            }
+            else
+            {
+                reserve(m_maxSize);
+                avail = m_end - m_cur;
+                if (avail)
+                {
+                    vsnprintf(m_cur, avail, fmt, copy);
+                    m_cur += avail - 1;
+                }
+                markTruncated();
+            }
+        }
+        va_end(copy);
+    }
+
+    void LogStream::clear()
+    {
+        if (m_data != m_inline && capacity() > kKeepSize)
+        {
+            delete[] m_data;
+            m_data = m_inline;
+            m_end = m_inline + kInlineSize;
+        }
+        m_cur = m_data;
+        m_truncated = false;
+        m_formatted = false;
+        m_fill = ' ';
+        m_flags = std::ios_base::skipws | std::ios_base::dec;
+        m_precision = kDefaultPrecision;
+        m_width = 0;
+    }
+
+    void LogStream::reserve(size_t cap)
+    {
+        cap = std::min(cap, m_maxSize);
+        if (cap > capacity())
+        {
+            grow(cap - size());
+        }
+    }
+
+    bool LogStream::grow(size_t len)
+    {
+        size_t need = size() + len;
+        if (need <= capacity())
+        {
+            return true;
+        }
+        if (need > m_maxSize)
+        {
+            return false;
+        }
+
+        size_t cap = std::min(std::max(capacity() * 2, need), m_maxSize);
+        char *data = new char[cap];
+        size_t n = size();
+        memcpy(data, m_data, n);
+        if (m_data != m_inline)
+        {
+            delete[] m_data;
+        }
+        m_data = data;
+        m_cur = data + n;
+        m_end = data + cap;
+        return true;
+    }
+
+    void LogStream::appendTruncated(const char *data, size_t len)
+    {
+        reserve(m_maxSize);
+        size_t n = std::min(len, (size_t)(m_end - m_cur));
+        memcpy(m_cur, data, n);
+        m_cur += n;
+        markTruncated();
+    }
+
+    void LogStream::markTruncated()
+    {
+        if (!m_truncated)
+        {
+            size_t n = sizeof(kTruncatedMarker) - 1;
+            memcpy(m_end - n, kTruncatedMarker, n);
+            m_truncated = true;
+        }
+        m_cur = m_end;
+    }
+
+    void LogStream::saveFormat(const std::ostream &os)
+    {
+        m_fill = os.fill();
+        m_flags = os.flags();
+        m_precision = os.precision();
+        m_width = os.width();
+        m_formatted = m_fill != ' ' || m_flags != (std::ios_base::skipws | std::ios_base::dec) ||
+                      m_precision != kDefaultPrecision || m_width != 0;
+    }
+
+    LogStream::Fallback::Fallback(LogStream &stream)
+        : m_stream(stream),
+          m_fs(nullptr),
+          m_owned(t_fallbackDestroyed)
+    {
+        // 线程局部的流被当前线程的所有LogStream共用
+        static thread_local FallbackStream t_fallback(true);
+        m_fs = m_owned ? new FallbackStream(false) : &t_fallback;
+        m_fs->buf.target = &stream;
+        // 每次使用前换成stream自己的格式状态
+        std::ostream &os = m_fs->os;
+        os.clear();
+        os.flags(stream.m_flags);
+        os.precision(stream.m_precision);
+        os.width(stream.m_width);
+        os.fill(stream.m_fill);
+    }
+
+    LogStream::Fallback::~Fallback()
+    {
+        m_stream.saveFormat(m_fs->os);
+        if (m_owned)
+        {
+            delete m_fs;
+        }
+    }
+
+    std::ostream &LogStream::Fallback::os()
+    {
+        return m_fs->os;
+    }
+}
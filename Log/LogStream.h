@@ -0,0 +1,224 @@
+/**
+ * @file LogStream.h
+ * @brief 日志内容流
+ * @author TenSir
+ * @date 2021年08月12日
+ * @copyright Copyright (c) 2021年
+ */
+#ifndef _TENSIR_LOGSTREAM_H
+#define _TENSIR_LOGSTREAM_H
+
+#include <string>
+#include <ostream>
+#include <stdint.h>
+#include <stdarg.h>
+#include <string.h>
+
+namespace tensir
+{
+    /**
+     * @brief 日志内容流
+     * @details 自带固定大小的内联缓冲，常见类型的operator<<手写实现，不经过iostream和locale。
+     *          内联缓冲写满后只在grow()中按倍数扩容到堆上，最多扩到getMaxSize()(默认64KB)，
+     *          超出部分丢弃，内容末尾替换为kTruncatedMarker，isTruncated()返回true。
+     *          其余类型回退到线程局部的std::ostream，直接写入本缓冲，不产生中间字符串。
+     *          std::hex、std::fixed、std::setprecision、std::setw等设置的格式状态保存在本对象中，
+     *          偏离默认状态后所有输出都经过std::ostream，结果与std::stringstream一致
+     */
+    class LogStream
+    {
+    public:
+        /// 内联缓冲大小
+        static const size_t kInlineSize = 4096;
+        /// 默认最大长度
+        static const size_t kDefaultMaxSize = 64 * 1024;
+        /// clear()时超过此容量的堆缓冲会被释放
+        static const size_t kKeepSize = 16 * 1024;
+        /// 截断时写在内容末尾的标记
+        static const char kTruncatedMarker[];
+        /// 默认的浮点数有效位数，与std::stringstream及快速路径的%g一致
+        static const std::streamsize kDefaultPrecision = 6;
+
+        LogStream();
+        ~LogStream();
+
+        LogStream(const LogStream &) = delete;
+        LogStream &operator=(const LogStream &) = delete;
+
+        LogStream &operator<<(bool v);
+        LogStream &operator<<(char v);
+        LogStream &operator<<(signed char v);
+        LogStream &operator<<(unsigned char v);
+        LogStream &operator<<(short v);
+        LogStream &operator<<(unsigned short v);
+        LogStream &operator<<(int v);
+        LogStream &operator<<(unsigned int v);
+        LogStream &operator<<(long v);
+        LogStream &operator<<(unsigned long v);
+        LogStream &operator<<(long long v);
+        LogStream &operator<<(unsigned long long v);
+        LogStream &operator<<(float v);
+        LogStream &operator<<(double v);
+        LogStream &operator<<(long double v);
+        LogStream &operator<<(const void *v);
+        LogStream &operator<<(const char *v);
+        LogStream &operator<<(const std::string &v);
+
+        /**
+         * @brief 支持std::endl、std::hex、std::fixed等操纵符，std::endl只输出换行不刷新
+         */
+        LogStream &operator<<(std::ostream &(*manip)(std::ostream &));
+        LogStream &operator<<(std::ios_base &(*manip)(std::ios_base &));
+
+        /**
+         * @brief 其他类型(包括std::setprecision、std::setw)交给它们自己的std::ostream输出运算符
+         */
+        template <class T>
+        LogStream &operator<<(const T &v)
+        {
+            return formatted(v);
+        }
+
+        /**
+         * @brief 追加数据
+         */
+        void append(const char *data, size_t len)
+        {
+            if (len <= (size_t)(m_end - m_cur) || grow(len))
+            {
+                memcpy(m_cur, data, len);
+                m_cur += len;
+            }
+            else
+            {
+                appendTruncated(data, len);
+            }
+        }
+
+        /**
+         * @brief 按printf格式追加
+         */
+        void appendf(const char *fmt, ...);
+        void appendv(const char *fmt, va_list al);
+
+        /**
+         * @brief 返回内容起始地址，内容不以'\0'结尾
+         */
+        const char *data() const { return m_data; }
+
+        /**
+         * @brief 返回内容长度
+         */
+        size_t size() const { return m_cur - m_data; }
+
+        bool empty() const { return m_cur == m_data; }
+
+        /**
+         * @brief 返回当前容量
+         */
+        size_t capacity() const { return m_end - m_data; }
+
+        /**
+         * @brief 内容是否因超过最大长度被截断，截断的内容以kTruncatedMarker结尾
+         */
+        bool isTruncated() const { return m_truncated; }
+
+        /**
+         * @brief 拷贝出内容
+         */
+        std::string str() const { return std::string(m_data, size()); }
+
+        /**
+         * @brief 清空内容并恢复默认格式状态，保留不超过kKeepSize的缓冲
+         */
+        void clear();
+
+        /**
+         * @brief 预留容量，不超过最大长度
+         */
+        void reserve(size_t cap);
+
+        size_t getMaxSize() const { return m_maxSize; }
+
+        /**
+         * @brief 设置最大长度，不小于kInlineSize，超出的内容被截断
+         */
+        void setMaxSize(size_t val) { m_maxSize = val < kInlineSize ? kInlineSize : val; }
+
+    private:
+        /**
+         * @brief 保证至少还有len字节空间
+         * @return 达到最大长度无法满足时返回false
+         */
+        bool grow(size_t len);
+
+        /**
+         * @brief 写入能放下的部分并标记截断
+         */
+        void appendTruncated(const char *data, size_t len);
+
+        /**
+         * @brief 用kTruncatedMarker覆盖内容末尾，之后不再写入
+         */
+        void markTruncated();
+
+        template <class T>
+        void appendInteger(T v);
+
+        /**
+         * @brief 按当前格式状态经std::ostream输出，并保存输出后的格式状态
+         */
+        template <class T>
+        LogStream &formatted(const T &v)
+        {
+            Fallback fallback(*this);
+            fallback.os() << v;
+            return *this;
+        }
+
+        /**
+         * @brief 保存os的格式状态，判断是否偏离默认状态
+         */
+        void saveFormat(const std::ostream &os);
+
+        /// 写入LogStream的std::ostream，定义在LogStream.cpp
+        struct FallbackStream;
+
+        /**
+         * @brief 借用一个写入stream并带有stream格式状态的std::ostream，析构时保存输出后的格式状态
+         * @details 通常借用线程局部的流；线程局部变量已析构时(如静态对象的析构函数中)临时创建一个
+         */
+        class Fallback
+        {
+        public:
+            explicit Fallback(LogStream &stream);
+            ~Fallback();
+
+            Fallback(const Fallback &) = delete;
+            Fallback &operator=(const Fallback &) = delete;
+
+            std::ostream &os();
+
+        private:
+            LogStream &m_stream;
+            FallbackStream *m_fs;
+            bool m_owned;
+        };
+
+    private:
+        char *m_data;
+        char *m_cur;
+        char *m_end;
+        size_t m_maxSize = kDefaultMaxSize;
+        bool m_truncated = false;
+        /// 格式状态是否偏离默认值，偏离时所有输出都经过std::ostream
+        bool m_formatted = false;
+        char m_fill = ' ';
+        std::ios_base::fmtflags m_flags = std::ios_base::skipws | std::ios_base::dec;
+        std::streamsize m_precision = kDefaultPrecision;
+        std::streamsize m_width = 0;
+        char m_inline[kInlineSize];
+    };
+}
+
+#endif
@@ -0,0 +1,515 @@
+#include "LogUring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define TENSIR_HAVE_IO_URING 1
+#endif
+#endif
+
+namespace tensir
+{
+#ifdef TENSIR_HAVE_IO_URING
+    /**
+     * @brief 只提交写请求的最小io_uring封装，直接使用系统调用
+     */
+    class UringLogAppender::Ring
+    {
+    public:
+        ~Ring()
+        {
+            if (m_sqes)
+            {
+                munmap(m_sqes, m_sqesSize);
+            }
+            if (m_cqRing && m_cqRing != m_sqRing)
+            {
+                munmap(m_cqRing, m_cqRingSize);
+            }
+            if (m_sqRing)
+            {
+                munmap(m_sqRing, m_sqRingSize);
+            }
+            if (m_fd >= 0)
+            {
+                ::close(m_fd);
+            }
+        }
+
+        /**
+         * @brief 创建io_uring并映射队列
+         * @return 内核不支持或被禁止时返回false
+         */
+        bool init(unsigned entries)
+        {
+            struct io_uring_params params;
+            memset(&params, 0, sizeof(params));
+            m_fd = syscall(__NR_io_uring_setup, entries, &params);
+            if (m_fd < 0)
+            {
+                return false;
+            }
+
+            m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            if (params.features & IORING_FEAT_SINGLE_MMAP)
+            {
+                m_sqRingSize = m_cqRingSize = std::max(m_sqRingSize, m_cqRingSize);
+            }
+            m_sqRing = Map(m_sqRingSize, IORING_OFF_SQ_RING);
+            if (!m_sqRing)
+            {
+                return false;
+            }
+            m_cqRing = (params.features & IORING_FEAT_SINGLE_MMAP) ? m_sqRing : Map(m_cqRingSize, IORING_OFF_CQ_RING);
+            if (!m_cqRing)
+            {
+                return false;
+            }
+            m_sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+            m_sqes = (struct io_uring_sqe *)Map(m_sqesSize, IORING_OFF_SQES);
+            if (!m_sqes)
+            {
+                return false;
+            }
+
+            char *sq = (char *)m_sqRing;
+            m_sqHead = (unsigned *)(sq + params.sq_off.head);
+            m_sqTail = (unsigned *)(sq + params.sq_off.tail);
+            m_sqMask = *(unsigned *)(sq + params.sq_off.ring_mask);
+            m_sqEntries = params.sq_entries;
+            m_sqArray = (unsigned *)(sq + params.sq_off.array);
+            char *cq = (char *)m_cqRing;
+            m_cqHead = (unsigned *)(cq + params.cq_off.head);
+            m_cqTail = (unsigned *)(cq + params.cq_off.tail);
+            m_cqMask = *(unsigned *)(cq + params.cq_off.ring_mask);
+            m_cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+            return true;
+        }
+
+        /**
+         * @brief 把一个写请求放入提交队列，由submit()交给内核
+         * @return 提交队列满时返回false
+         */
+        bool queue(int fd, const char *data, size_t len, uint64_t offset, void *user)
+        {
+            unsigned tail = *m_sqTail;
+            if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+            {
+                return false;
+            }
+            unsigned index = tail & m_sqMask;
+            struct io_uring_sqe *sqe = &m_sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_WRITE;
+            sqe->fd = fd;
+            sqe->addr = (uint64_t)(uintptr_t)data;
+            sqe->len = len;
+            sqe->off = offset;
+            sqe->user_data = (uint64_t)(uintptr_t)user;
+            m_sqArray[index] = index;
+            __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+        /**
+         * @brief 把提交队列中还没交给内核的请求全部提交，wait为true时至少等待一个完成事件
+         * @return 失败时返回false，errno为EBUSY或EAGAIN时请求仍留在队列中，下次submit()再提交
+         */
+        bool submit(bool wait)
+        {
+            unsigned queued = *m_sqTail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+            if (!queued && !wait)
+            {
+                return true;
+            }
+            return enter(queued, wait ? 1 : 0) >= 0;
+        }
+
+        /**
+         * @brief 撤回内核还没取走的请求，只能在submit()失败后调用
+         * @details 没有使用SQPOLL，内核只在io_uring_enter中读取提交队列，返回后未取走的请求可以安全撤回
+         */
+        void retract(std::vector<void *> &users)
+        {
+            unsigned head = __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE);
+            for (unsigned i = head; i != *m_sqTail; ++i)
+            {
+                users.push_back((void *)(uintptr_t)m_sqes[i & m_sqMask].user_data);
+            }
+            __atomic_store_n(m_sqTail, head, __ATOMIC_RELEASE);
+        }
+
+        /**
+         * @brief 取出一个完成事件
+         * @return 没有完成事件时返回false
+         */
+        bool peek(void *&user, int &res)
+        {
+            unsigned head = *m_cqHead;
+            if (head == __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE))
+            {
+                return false;
+            }
+            struct io_uring_cqe *cqe = &m_cqes[head & m_cqMask];
+            user = (void *)(uintptr_t)cqe->user_data;
+            res = cqe->res;
+            __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+            return true;
+        }
+
+    private:
+        void *Map(size_t size, off_t offset)
+        {
+            void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, offset);
+            return p == MAP_FAILED ? nullptr : p;
+        }
+
+        int enter(unsigned submit, unsigned wait)
+        {
+            int ret;
+            do
+            {
+                ret = syscall(__NR_io_uring_enter, m_fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            } while (ret < 0 && errno == EINTR);
+            return ret;
+        }
+
+    private:
+        int m_fd = -1;
+        void *m_sqRing = nullptr;
+        size_t m_sqRingSize = 0;
+        void *m_cqRing = nullptr;
+        size_t m_cqRingSize = 0;
+        struct io_uring_sqe *m_sqes = nullptr;
+        size_t m_sqesSize = 0;
+        unsigned *m_sqHead = nullptr;
+        unsigned *m_sqTail = nullptr;
+        unsigned m_sqMask = 0;
+        unsigned m_sqEntries = 0;
+        unsigned *m_sqArray = nullptr;
+        unsigned *m_cqHead = nullptr;
+        unsigned *m_cqTail = nullptr;
+        unsigned m_cqMask = 0;
+        struct io_uring_cqe *m_cqes = nullptr;
+    };
+#else
+    /**
+     * @brief 没有io_uring头文件时的占位，init总是失败
+     */
+    class UringLogAppender::Ring
+    {
+    public:
+        bool init(unsigned) { return false; }
+        bool queue(int, const char *, size_t, uint64_t, void *) { return false; }
+        bool submit(bool) { return false; }
+        void retract(std::vector<void *> &) {}
+        bool peek(void *&, int &) { return false; }
+    };
+#endif
+
+    UringLogAppender::UringLogAppender(const std::string &filename, size_t buffer_size, uint32_t queue_depth, bool use_uring)
+        : m_filename(filename),
+          m_bufferSize(std::max<size_t>(buffer_size, 4096)),
+          m_queueDepth(std::max<uint32_t>(queue_depth, 1))
+    {
+        m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        struct stat st;
+        if (m_fd >= 0 && fstat(m_fd, &st) == 0)
+        {
+            m_offset = st.st_size;
+        }
+        if (use_uring)
+        {
+            m_ring.reset(new Ring);
+            if (!m_ring->init(m_queueDepth + 1))
+            {
+                m_ring.reset();
+            }
+        }
+        // 在写的m_queueDepth块加上正在填充的一块
+        for (uint32_t i = 0; i <= m_queueDepth; ++i)
+        {
+            m_buffers.emplace_back(new Buffer);
+            m_buffers.back()->data.reserve(m_bufferSize);
+            m_free.push_back(m_buffers.back().get());
+        }
+        m_current = m_free.back();
+        m_free.pop_back();
+    }
+
+    UringLogAppender::~UringLogAppender()
+    {
+        sync();
+        m_ring.reset();
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    void UringLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event)
+    {
+        if (level >= getLevel())
+        {
+            MutexType::Lock lock(m_mutex);
+            formatEvent(*m_formatter, m_current->data, logger.get(), level, *event);
+            if (m_current->data.size() >= m_bufferSize)
+            {
+                submitCurrent();
+            }
+        }
+    }
+
+    std::string UringLogAppender::toYamlString()
+    {
+        // YAML::Node node;
+        // node["type"] = "UringLogAppender";
+        // node["file"] = m_filename;
+        return "";
+    }
+
+    void UringLogAppender::append(const char *data, size_t len)
+    {
+        addWritten(len);
+        MutexType::Lock lock(m_mutex);
+        write(data, len);
+    }
+
+    void UringLogAppender::flush()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (!m_current->data.empty())
+        {
+            submitCurrent();
+        }
+        if (m_ring)
+        {
+            reap(false);
+        }
+        else
+        {
+            writePending();
+        }
+    }
+
+    void UringLogAppender::sync()
+    {
+        MutexType::Lock lock(m_mutex);
+        if (!m_current->data.empty())
+        {
+            submitCurrent();
+        }
+        writePending();
+        while (m_inflight)
+        {
+            reap(true);
+        }
+    }
+
+    uint64_t UringLogAppender::getDroppedBytes()
+    {
+        MutexType::Lock lock(m_mutex);
+        return m_dropped;
+    }
+
+    void UringLogAppender::write(const char *data, size_t len)
+    {
+        while (len)
+        {
+            size_t n = std::min(len, m_bufferSize - std::min(m_bufferSize, m_current->data.size()));
+            m_current->data.append(data, n);
+            data += n;
+            len -= n;
+            if (m_current->data.size() >= m_bufferSize)
+            {
+                submitCurrent();
+            }
+        }
+    }
+
+    void UringLogAppender::submitCurrent()
+    {
+        Buffer *buffer = m_current;
+        buffer->offset = m_offset;
+        buffer->done = 0;
+        m_offset += buffer->data.size();
+
+        if (m_ring)
+        {
+            submit(buffer);
+            // 顺便回收已经完成的缓冲，不进入内核
+            reap(false);
+        }
+        else
+        {
+            m_pending.push_back(buffer);
+            if (m_pending.size() >= m_queueDepth)
+            {
+                writePending();
+            }
+        }
+
+        // 所有缓冲都在写时才等待
+        while (m_free.empty())
+        {
+            if (m_ring)
+            {
+                reap(true);
+            }
+            else
+            {
+                writePending();
+            }
+        }
+        m_current = m_free.back();
+        m_free.pop_back();
+    }
+
+    void UringLogAppender::submit(Buffer *buffer)
+    {
+        ++m_inflight;
+        while (!m_ring->queue(m_fd, buffer->data.data() + buffer->done, buffer->data.size() - buffer->done,
+                              buffer->offset + buffer->done, buffer))
+        {
+            // 提交队列满，先提交已排队的请求并处理一些完成事件
+            reap(true);
+        }
+        submitQueued(false);
+    }
+
+    bool UringLogAppender::submitQueued(bool wait)
+    {
+        if (m_ring->submit(wait))
+        {
+            return true;
+        }
+        if (errno == EBUSY || errno == EAGAIN)
+        {
+            // 完成队列溢出或内核暂时无法分配，请求留在队列中，下次提交时再交给内核
+            return false;
+        }
+
+        // io_uring出错时撤回内核还没取走的请求，逐块同步写出；已取走的请求照常等待完成事件
+        std::vector<void *> users;
+        m_ring->retract(users);
+        for (void *user : users)
+        {
+            --m_inflight;
+            m_pending.push_back((Buffer *)user);
+            writePending();
+        }
+        return false;
+    }
+
+    void UringLogAppender::reap(bool wait)
+    {
+        void *user;
+        int res;
+        bool got = false;
+        if (!wait)
+        {
+            // 提交之前因EBUSY或EAGAIN留在队列中的请求
+            submitQueued(false);
+        }
+        while (true)
+        {
+            if (!m_ring->peek(user, res))
+            {
+                if (!wait || got || !m_inflight || !submitQueued(true))
+                {
+                    return;
+                }
+                continue;
+            }
+            got = true;
+            --m_inflight;
+            Buffer *buffer = (Buffer *)user;
+            if (res == -EAGAIN || res == -EINTR)
+            {
+                submit(buffer);
+            }
+            else if (res <= 0)
+            {
+                m_dropped += buffer->data.size() - buffer->done;
+                release(buffer);
+            }
+            else if (buffer->done + res < buffer->data.size())
+            {
+                // 部分写入，接着写剩下的
+                buffer->done += res;
+                submit(buffer);
+            }
+            else
+            {
+                release(buffer);
+            }
+        }
+    }
+
+    void UringLogAppender::writePending()
+    {
+        if (m_pending.empty())
+        {
+            return;
+        }
+        // 待写缓冲在文件中是连续的，合并成一次pwritev
+        std::vector<struct iovec> iov;
+        for (Buffer *buffer : m_pending)
+        {
+            struct iovec v;
+            v.iov_base = &buffer->data[buffer->done];
+            v.iov_len = buffer->data.size() - buffer->done;
+            iov.push_back(v);
+        }
+        uint64_t offset = m_pending.front()->offset + m_pending.front()->done;
+        size_t first = 0;
+        while (first < iov.size())
+        {
+            ssize_t n = pwritev(m_fd, &iov[first], std::min<size_t>(iov.size() - first, IOV_MAX), offset);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                for (; first < iov.size(); ++first)
+                {
+                    m_dropped += iov[first].iov_len;
+                }
+                break;
+            }
+            offset += n;
+            while (first < iov.size() && (size_t)n >= iov[first].iov_len)
+            {
+                n -= iov[first].iov_len;
+                ++first;
+            }
+            if (n > 0)
+            {
+                iov[first].iov_base = (char *)iov[first].iov_base + n;
+                iov[first].iov_len -= n;
+            }
+        }
+        for (Buffer *buffer : m_pending)
+        {
+            release(buffer);
+        }
+        m_pending.clear();
+    }
+
+    void UringLogAppender::release(Buffer *buffer)
+    {
+        buffer->data.clear();
+        buffer->done = 0;
+        m_free.push_back(buffer);
+    }
+}
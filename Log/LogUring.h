@@ -0,0 +1,146 @@
+/**
+ * @file LogUring.h
+ * @brief io_uring批量写文件
+ * @author TenSir
+ * @date 2021年08月12日
+ * @copyright Copyright (c) 2021年
+ */
+#ifndef _TENSIR_LOGURING_H
+#define _TENSIR_LOGURING_H
+
+#include "Log.h"
+
+namespace tensir
+{
+    /**
+     * @brief 通过io_uring批量写文件的Appender
+     * @details 日志追加到当前缓冲，缓冲写满后作为一个写请求提交到io_uring，换下一块空缓冲继续写，
+     *          同时可以有多块缓冲在写。完成事件直接从完成队列读取，不需要系统调用，也不会阻塞在write()上，
+     *          只有所有缓冲都在写时才等待一个完成。内核不支持io_uring时退化为攒满多块缓冲后一次pwritev。
+     *          每块缓冲写入文件中预先确定的偏移，文件不能同时被其他进程追加。适合作为AsyncLogAppender的目标
+     */
+    class UringLogAppender : public LogAppender
+    {
+    public:
+        typedef std::shared_ptr<UringLogAppender> ptr;
+
+        /**
+         * @brief 构造函数
+         * @param[in] filename 文件路径，已存在时追加
+         * @param[in] buffer_size 单块缓冲大小(字节)
+         * @param[in] queue_depth 同时在写的缓冲块数
+         * @param[in] use_uring 为false时总是使用pwritev
+         */
+        UringLogAppender(const std::string &filename, size_t buffer_size = 1024 * 1024,
+                         uint32_t queue_depth = 4, bool use_uring = true);
+
+        /**
+         * @brief 析构函数，等待所有缓冲写完后关闭文件
+         */
+        ~UringLogAppender();
+
+        void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+        std::string toYamlString() override;
+        void append(const char *data, size_t len) override;
+        bool supportsAppend() const override { return true; }
+
+        /**
+         * @brief 提交当前缓冲，不等待写完
+         */
+        void flush() override;
+
+        /**
+         * @brief 等待所有已提交的缓冲写完
+         */
+        void sync();
+
+        /**
+         * @brief 是否在使用io_uring
+         */
+        bool isUringEnabled() const { return !!m_ring; }
+
+        /**
+         * @brief 返回写入失败被丢弃的字节数
+         */
+        uint64_t getDroppedBytes();
+
+        class Ring;
+
+    private:
+        struct Buffer
+        {
+            /// 数据
+            std::string data;
+            /// 在文件中的偏移
+            uint64_t offset = 0;
+            /// 已经写入的字节数
+            size_t done = 0;
+        };
+
+        /**
+         * @brief 写入数据，需持有m_mutex
+         */
+        void write(const char *data, size_t len);
+
+        /**
+         * @brief 提交当前缓冲并换一块空缓冲，需持有m_mutex
+         */
+        void submitCurrent();
+
+        /**
+         * @brief 把buffer中还没写入的部分放入提交队列并提交，需持有m_mutex
+         */
+        void submit(Buffer *buffer);
+
+        /**
+         * @brief 把提交队列中已排队的请求交给内核，wait为true时至少等待一个完成事件，需持有m_mutex
+         * @details 只重新提交已在队列中的请求，不会为同一块缓冲再排队一次；
+         *          io_uring出错时只有内核还没取走的请求被撤回并同步写出
+         * @return 失败时返回false
+         */
+        bool submitQueued(bool wait);
+
+        /**
+         * @brief 处理完成事件，wait为true时至少等待一个，需持有m_mutex
+         */
+        void reap(bool wait);
+
+        /**
+         * @brief 用pwritev写出所有待写缓冲，需持有m_mutex
+         */
+        void writePending();
+
+        /**
+         * @brief 回收写完的缓冲，需持有m_mutex
+         */
+        void release(Buffer *buffer);
+
+    private:
+        /// 文件路径
+        std::string m_filename;
+        /// 单块缓冲大小
+        size_t m_bufferSize;
+        /// 同时在写的缓冲块数
+        uint32_t m_queueDepth;
+        /// 文件描述符
+        int m_fd = -1;
+        /// 下一块缓冲的写入偏移
+        uint64_t m_offset = 0;
+        /// io_uring，不可用时为空
+        std::unique_ptr<Ring> m_ring;
+        /// 所有缓冲
+        std::vector<std::unique_ptr<Buffer>> m_buffers;
+        /// 空闲缓冲
+        std::vector<Buffer *> m_free;
+        /// 使用pwritev时等待写出的缓冲
+        std::vector<Buffer *> m_pending;
+        /// 当前写入的缓冲
+        Buffer *m_current = nullptr;
+        /// 正在写的缓冲块数
+        uint32_t m_inflight = 0;
+        /// 写入失败丢弃的字节数
+        uint64_t m_dropped = 0;
+    };
+}
+
+#endif
@@ -0,0 +1,97 @@
+#include "LogWorker.h"
+
+namespace tensir
+{
+    LogWorker &LogWorker::Instance()
+    {
+        // 故意不析构：全局或静态的Appender可能在本对象之后析构，析构时仍要调用cancel
+        static LogWorker *s_worker = new LogWorker;
+        return *s_worker;
+    }
+
+    LogWorker::LogWorker()
+    {
+        m_thread = std::thread(&LogWorker::run, this);
+    }
+
+    LogWorker::~LogWorker()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_running = false;
+            m_cond.notify_one();
+        }
+        m_thread.join();
+    }
+
+    uint64_t LogWorker::schedule(uint32_t interval, Task task)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        uint64_t id = m_nextId++;
+        Entry &entry = m_entries[id];
+        entry.interval = std::chrono::milliseconds(interval);
+        entry.due = Clock::now() + entry.interval;
+        entry.task = std::make_shared<Task>(std::move(task));
+        m_cond.notify_one();
+        return id;
+    }
+
+    void LogWorker::trigger(uint64_t id)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(id);
+        if (it != m_entries.end())
+        {
+            it->second.due = Clock::time_point::min();
+            m_cond.notify_one();
+        }
+    }
+
+    void LogWorker::cancel(uint64_t id)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_entries.erase(id);
+        if (std::this_thread::get_id() != m_thread.get_id())
+        {
+            m_doneCond.wait(lock, [this, id]() { return m_current != id; });
+        }
+    }
+
+    void LogWorker::run()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_running)
+        {
+            auto next = m_entries.end();
+            for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+            {
+                if (next == m_entries.end() || it->second.due < next->second.due)
+                {
+                    next = it;
+                }
+            }
+            if (next == m_entries.end())
+            {
+                m_cond.wait(lock);
+                continue;
+            }
+            Clock::time_point now = Clock::now();
+            if (next->second.due > now)
+            {
+                // 等待期间任务可能被取消，不能引用任务表中的时间
+                Clock::time_point due = next->second.due;
+                m_cond.wait_until(lock, due);
+                continue;
+            }
+
+            next->second.due = now + next->second.interval;
+            std::shared_ptr<Task> task = next->second.task;
+            m_current = next->first;
+            lock.unlock();
+            (*task)();
+            lock.lock();
+            m_current = 0;
+            m_doneCond.notify_all();
+        }
+    }
+}
@@ -0,0 +1,102 @@
+/**
+ * @file LogWorker.h
+ * @brief 日志后台维护线程
+ * @author TenSir
+ * @date 2021年08月12日
+ * @copyright Copyright (c) 2021年
+ */
+#ifndef _TENSIR_LOGWORKER_H
+#define _TENSIR_LOGWORKER_H
+
+#include <stdint.h>
+#include <functional>
+#include <memory>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+namespace tensir
+{
+    /**
+     * @brief 所有Appender共用的后台线程，执行周期性的维护任务
+     * @details 预先打开下一个日志文件、关闭旧文件、清理过期文件等会阻塞的操作都放在这里，
+     *          不占用写日志的线程。任务应当很快返回，不能在任务中等待其他任务
+     */
+    class LogWorker
+    {
+    public:
+        typedef std::function<void()> Task;
+
+        /**
+         * @brief 返回全局唯一的后台线程
+         * @details 单例从不析构，进程退出时静态对象的析构函数仍可以调用schedule和cancel
+         */
+        static LogWorker &Instance();
+
+        /**
+         * @brief 析构函数，停止后台线程
+         */
+        ~LogWorker();
+
+        /**
+         * @brief 添加周期任务
+         * @param[in] interval 执行间隔(毫秒)
+         * @param[in] task 任务
+         * @return 任务id
+         */
+        uint64_t schedule(uint32_t interval, Task task);
+
+        /**
+         * @brief 让任务尽快执行一次，之后仍按原间隔执行
+         */
+        void trigger(uint64_t id);
+
+        /**
+         * @brief 取消任务
+         * @details 任务正在执行时等待其返回，返回后任务不会再被执行。在任务内取消自己时不等待
+         */
+        void cancel(uint64_t id);
+
+    private:
+        LogWorker();
+
+        /**
+         * @brief 后台线程主循环
+         */
+        void run();
+
+    private:
+        typedef std::chrono::steady_clock Clock;
+
+        struct Entry
+        {
+            /// 执行间隔
+            std::chrono::milliseconds interval;
+            /// 下次执行时间
+            Clock::time_point due;
+            /// 任务
+            std::shared_ptr<Task> task;
+        };
+
+        /// 保护任务表
+        std::mutex m_mutex;
+        /// 通知后台线程
+        std::condition_variable m_cond;
+        /// 通知cancel调用者
+        std::condition_variable m_doneCond;
+        /// 任务表
+        std::map<uint64_t, Entry> m_entries;
+        /// 下一个任务id
+        uint64_t m_nextId = 1;
+        /// 正在执行的任务id
+        uint64_t m_current = 0;
+        /// 是否运行
+        bool m_running = true;
+        /// 后台线程
+        std::thread m_thread;
+    };
+}
+
+#endif
@@ -0,0 +1,497 @@
+/**
+ * @file log_bench.cpp
+ * @brief 日志端到端性能测试
+ * @details 对每种Appender、格式模板、打日志方式和线程数的组合，测量每次调用的延迟分位数和总吞吐，
+ *          每个组合输出一行JSON到标准输出，便于不同构建之间比较。标准输出的文件描述符被重定向到/dev/null，
+ *          StdoutLogAppender的输出不会混进结果
+ */
+#include "../Log.h"
+#include "../LogMmap.h"
+#include "../LogUring.h"
+#include "../LogBinary.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace tensir;
+
+namespace
+{
+    /**
+     * @brief 命令行参数
+     */
+    struct Options
+    {
+        /// 线程数
+        std::vector<int> threads;
+        /// 每个线程的日志条数
+        uint64_t messages = 20000;
+        /// 每个线程正式计时前的预热条数
+        uint64_t warmup = 2000;
+        /// Appender
+        std::vector<std::string> sinks;
+        /// 格式模板名
+        std::vector<std::string> patterns;
+        /// 打日志方式
+        std::vector<std::string> paths;
+        /// 日志文件目录
+        std::string dir = "/tmp/log_bench";
+    };
+
+    struct Pattern
+    {
+        const char *name;
+        const char *pattern;
+    };
+
+    const Pattern kPatterns[] = {
+        {"default", "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"},
+        {"message", "%m%n"},
+        {"json", "json"},
+        {"logfmt", "logfmt"},
+    };
+
+    const char *kSinks[] = {"stdout", "console", "file", "async", "dispatcher", "mmap", "uring", "binary"};
+
+    const char *kPaths[] = {"stream", "fmt", "defer", "kv"};
+
+    /**
+     * @brief 一个测试组合使用的日志器和收尾操作
+     */
+    struct Sink
+    {
+        Logger::ptr logger;
+        /// 等待缓冲的日志全部写出
+        std::function<void()> drain;
+        /// 被丢弃的日志条数
+        std::function<uint64_t()> dropped;
+        /// 测试结束后删除的文件
+        std::vector<std::string> files;
+    };
+
+    /// 结果输出，指向原来的标准输出
+    FILE *s_out = nullptr;
+    /// 打开的/dev/null
+    int s_devnull = -1;
+
+    uint64_t MonotonicNS()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+    std::vector<std::string> Split(const std::string &str)
+    {
+        std::vector<std::string> result;
+        size_t begin = 0;
+        while (begin <= str.size())
+        {
+            size_t end = str.find(',', begin);
+            if (end == std::string::npos)
+            {
+                end = str.size();
+            }
+            if (end > begin)
+            {
+                result.push_back(str.substr(begin, end - begin));
+            }
+            begin = end + 1;
+        }
+        return result;
+    }
+
+    void Usage(const char *argv0)
+    {
+        fprintf(stderr,
+                "usage: %s [--threads 1,2,4] [--messages N] [--warmup N] [--sinks a,b]\n"
+                "          [--patterns a,b] [--paths a,b] [--dir DIR]\n"
+                "  sinks:    stdout console file async dispatcher mmap uring binary\n"
+                "  patterns: default message json logfmt\n"
+                "  paths:    stream fmt defer kv\n",
+                argv0);
+    }
+
+    bool ParseOptions(int argc, char **argv, Options &opts)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            std::string arg = argv[i];
+            if (arg == "--help" || arg == "-h" || i + 1 == argc)
+            {
+                return false;
+            }
+            std::string value = argv[++i];
+            if (arg == "--threads")
+            {
+                opts.threads.clear();
+                for (auto &j : Split(value))
+                {
+                    opts.threads.push_back(std::max(1, atoi(j.c_str())));
+                }
+            }
+            else if (arg == "--messages")
+            {
+                opts.messages = std::max(1ull, strtoull(value.c_str(), nullptr, 10));
+            }
+            else if (arg == "--warmup")
+            {
+                opts.warmup = strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (arg == "--sinks")
+            {
+                opts.sinks = Split(value);
+            }
+            else if (arg == "--patterns")
+            {
+                opts.patterns = Split(value);
+            }
+            else if (arg == "--paths")
+            {
+                opts.paths = Split(value);
+            }
+            else if (arg == "--dir")
+            {
+                opts.dir = value;
+            }
+            else
+            {
+                return false;
+            }
+        }
+
+        if (opts.threads.empty())
+        {
+            // 1, 2, 4...直到CPU个数
+            int n = std::max(1u, std::thread::hardware_concurrency());
+            for (int i = 1; i < n; i *= 2)
+            {
+                opts.threads.push_back(i);
+            }
+            opts.threads.push_back(n);
+        }
+        if (opts.sinks.empty())
+        {
+            opts.sinks.assign(std::begin(kSinks), std::end(kSinks));
+        }
+        if (opts.patterns.empty())
+        {
+            for (auto &i : kPatterns)
+            {
+                opts.patterns.push_back(i.name);
+            }
+        }
+        if (opts.paths.empty())
+        {
+            opts.paths.assign(std::begin(kPaths), std::end(kPaths));
+        }
+        return true;
+    }
+
+    const char *FindPattern(const std::string &name)
+    {
+        for (auto &i : kPatterns)
+        {
+            if (name == i.name)
+            {
+                return i.pattern;
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief 创建测试用的日志器，未知的Appender返回false
+     */
+    bool CreateSink(const std::string &name, const std::string &pattern, const std::string &dir, Sink &sink)
+    {
+        sink.logger.reset(new Logger("bench"));
+        sink.logger->setLevel(LogLevel::DEBUG);
+        sink.drain = []() {};
+        sink.dropped = []() -> uint64_t { return 0; };
+        LogFormatter::ptr formatter(new LogFormatter(pattern));
+        std::string file = dir + "/" + name + ".log";
+
+        LogAppender::ptr appender;
+        if (name == "stdout")
+        {
+            appender.reset(new StdoutLogAppender);
+        }
+        else if (name == "console")
+        {
+            appender.reset(new ConsoleLogAppender(s_devnull));
+        }
+        else if (name == "file")
+        {
+            appender.reset(new FileLogAppender(file));
+        }
+        else if (name == "async")
+        {
+            LogAppender::ptr target(new FileLogAppender(file));
+            target->setFormatter(formatter);
+            std::shared_ptr<AsyncLogAppender> async(new AsyncLogAppender(target));
+            sink.dropped = [async]() { return async->getDroppedCount(); };
+            appender = async;
+        }
+        else if (name == "dispatcher")
+        {
+            appender.reset(new FileLogAppender(file));
+            LogDispatcher::ptr dispatcher(new LogDispatcher);
+            sink.logger->setDispatcher(dispatcher);
+            sink.drain = [dispatcher]() { dispatcher->flush(); };
+            sink.dropped = [dispatcher]() { return dispatcher->getDroppedCount(); };
+        }
+        else if (name == "mmap")
+        {
+            appender.reset(new MmapLogAppender(file));
+        }
+        else if (name == "uring")
+        {
+            std::shared_ptr<UringLogAppender> uring(new UringLogAppender(file));
+            sink.drain = [uring]() {
+                uring->flush();
+                uring->sync();
+            };
+            appender = uring;
+        }
+        else if (name == "binary")
+        {
+            appender.reset(new BinaryLogAppender(file));
+        }
+        else
+        {
+            return false;
+        }
+
+        appender->setFormatter(formatter);
+        sink.logger->addAppender(appender);
+        std::function<void()> drain = sink.drain;
+        sink.drain = [drain, appender]() {
+            drain();
+            appender->flush();
+        };
+        sink.files.push_back(file);
+        return true;
+    }
+
+    /**
+     * @brief 按指定方式打一条日志
+     */
+    inline void LogOnce(const Logger::ptr &logger, int path, uint64_t i)
+    {
+        switch (path)
+        {
+        case 0:
+            TENSIR_LOG_LEVEL(logger, LogLevel::INFO) << "bench message " << i << " value " << 3.25;
+            break;
+        case 1:
+            TENSIR_LOG_FMT_LEVEL(logger, LogLevel::INFO, "bench message %llu value %g", (unsigned long long)i, 3.25);
+            break;
+        case 2:
+            TENSIR_LOG_DEFER_LEVEL(logger, LogLevel::INFO, "bench message %llu value %g", (unsigned long long)i, 3.25);
+            break;
+        default:
+            TENSIR_LOG_EVENT(logger, LogLevel::INFO).with("i", i).with("value", 3.25).getSS() << "bench message";
+            break;
+        }
+    }
+
+    /**
+     * @brief 排序后数组的分位数
+     */
+    uint64_t Percentile(const std::vector<uint32_t> &sorted, double p)
+    {
+        if (sorted.empty())
+        {
+            return 0;
+        }
+        size_t idx = (size_t)(p * (sorted.size() - 1) + 0.5);
+        return sorted[std::min(idx, sorted.size() - 1)];
+    }
+
+    /**
+     * @brief 运行一个组合并输出一行结果
+     */
+    void RunCase(const Options &opts, const std::string &sink_name, const std::string &pattern_name,
+                 const std::string &path_name, int path, int threads)
+    {
+        // 二进制Appender不用格式模板，标签不是模板名
+        const char *pattern = FindPattern(pattern_name);
+        Sink sink;
+        if (!CreateSink(sink_name, pattern ? pattern : kPatterns[0].pattern, opts.dir, sink))
+        {
+            fprintf(stderr, "unknown sink: %s\n", sink_name.c_str());
+            return;
+        }
+
+        std::vector<std::vector<uint32_t>> latencies(threads);
+        std::atomic<int> ready(0);
+        std::atomic<bool> go(false);
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t)
+        {
+            workers.push_back(std::thread([&, t]() {
+                std::vector<uint32_t> &lat = latencies[t];
+                lat.resize(opts.messages);
+                for (uint64_t i = 0; i < opts.warmup; ++i)
+                {
+                    LogOnce(sink.logger, path, i);
+                }
+                ++ready;
+                while (!go.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+                for (uint64_t i = 0; i < opts.messages; ++i)
+                {
+                    uint64_t begin = MonotonicNS();
+                    LogOnce(sink.logger, path, i);
+                    uint64_t ns = MonotonicNS() - begin;
+                    lat[i] = ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+                }
+            }));
+        }
+
+        while (ready.load() != threads)
+        {
+            std::this_thread::yield();
+        }
+        // 预热写出的日志不计入
+        sink.drain();
+        uint64_t start = MonotonicNS();
+        go.store(true, std::memory_order_release);
+        for (auto &i : workers)
+        {
+            i.join();
+        }
+        uint64_t end = MonotonicNS();
+        sink.drain();
+        uint64_t drained = MonotonicNS();
+
+        std::vector<uint32_t> all;
+        all.reserve(opts.messages * threads);
+        for (auto &i : latencies)
+        {
+            all.insert(all.end(), i.begin(), i.end());
+        }
+        std::sort(all.begin(), all.end());
+        double sum = 0;
+        for (uint32_t i : all)
+        {
+            sum += i;
+        }
+
+        uint64_t total = opts.messages * threads;
+        double seconds = (end - start) / 1e9;
+        double drained_seconds = (drained - start) / 1e9;
+        fprintf(s_out,
+                "{\"type\":\"result\",\"sink\":\"%s\",\"pattern\":\"%s\",\"path\":\"%s\",\"threads\":%d,"
+                "\"messages\":%llu,\"seconds\":%.6f,\"msgs_per_sec\":%.0f,\"drained_msgs_per_sec\":%.0f,"
+                "\"mean_ns\":%.1f,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu,\"dropped\":%llu}\n",
+                sink_name.c_str(), pattern_name.c_str(), path_name.c_str(), threads,
+                (unsigned long long)total, seconds, total / seconds, total / drained_seconds,
+                all.empty() ? 0.0 : sum / all.size(),
+                (unsigned long long)Percentile(all, 0.5), (unsigned long long)Percentile(all, 0.99),
+                (unsigned long long)Percentile(all, 0.999), (unsigned long long)(all.empty() ? 0 : all.back()),
+                (unsigned long long)sink.dropped());
+        fflush(s_out);
+
+        std::vector<std::string> files = sink.files;
+        sink = Sink();
+        for (auto &i : files)
+        {
+            unlink(i.c_str());
+        }
+    }
+
+    /**
+     * @brief 计时本身的开销(纳秒)
+     */
+    double TimerOverhead()
+    {
+        const int n = 100000;
+        uint64_t begin = MonotonicNS();
+        uint64_t sink = 0;
+        for (int i = 0; i < n; ++i)
+        {
+            sink += MonotonicNS();
+        }
+        uint64_t end = MonotonicNS();
+        return sink ? (end - begin) / (double)n : 0;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options opts;
+    if (!ParseOptions(argc, argv, opts))
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+    for (auto &i : opts.patterns)
+    {
+        if (!FindPattern(i))
+        {
+            fprintf(stderr, "unknown pattern: %s\n", i.c_str());
+            return 1;
+        }
+    }
+    for (auto &i : opts.paths)
+    {
+        if (std::find(std::begin(kPaths), std::end(kPaths), i) == std::end(kPaths))
+        {
+            fprintf(stderr, "unknown path: %s\n", i.c_str());
+            return 1;
+        }
+    }
+    mkdir(opts.dir.c_str(), 0755);
+
+    // 结果写到原来的标准输出，标准输出本身指向/dev/null
+    fflush(stdout);
+    s_out = fdopen(dup(STDOUT_FILENO), "w");
+    s_devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (!s_out || s_devnull < 0 || dup2(s_devnull, STDOUT_FILENO) < 0)
+    {
+        perror("redirect stdout");
+        return 1;
+    }
+
+    fprintf(s_out,
+            "{\"type\":\"meta\",\"compiler\":\"%s\",\"optimized\":%s,\"cpus\":%u,\"messages_per_thread\":%llu,"
+            "\"warmup_per_thread\":%llu,\"timer_overhead_ns\":%.1f}\n",
+            __VERSION__,
+#ifdef __OPTIMIZE__
+            "true",
+#else
+            "false",
+#endif
+            std::thread::hardware_concurrency(), (unsigned long long)opts.messages,
+            (unsigned long long)opts.warmup, TimerOverhead());
+    fflush(s_out);
+
+    for (auto &sink : opts.sinks)
+    {
+        for (auto &pattern : opts.patterns)
+        {
+            // 二进制Appender不使用格式模板，只跑第一个
+            if (sink == "binary" && pattern != opts.patterns.front())
+            {
+                continue;
+            }
+            for (auto &path : opts.paths)
+            {
+                int path_id = std::find(std::begin(kPaths), std::end(kPaths), path) - std::begin(kPaths);
+                for (int threads : opts.threads)
+                {
+                    RunCase(opts, sink, sink == "binary" ? "binary" : pattern, path, path_id, threads);
+                }
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include "../Log.h"
+#include <iostream>
+
+using namespace tensir;
+
+int main()
+{
+    tensir::Logger::ptr logger(new tensir::Logger);
+    tensir::AsyncLogAppender::ptr appender(new tensir::AsyncLogAppender(
+        tensir::LogAppender::ptr(new tensir::FileLogAppender("./async_test.log")), 1000));
+    logger->addAppender(appender);
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        tensir::LogEvent::ptr event(new tensir::LogEvent(logger,
+                                                         tensir::LogLevel::INFO,
+                                                         __FILE__,
+                                                         __LINE__,
+                                                         0,
+                                                         0,
+                                                         1,
+                                                         tensir::GetCurrentNS(),
+                                                         "main"));
+        event->getSS() << "async message " << i;
+        logger->log(tensir::LogLevel::INFO, event);
+    }
+    std::cout << "queue depth: " << appender->getQueueDepth() << std::endl;
+
+    appender->flush();
+    std::cout << "flushed, queue depth: " << appender->getQueueDepth() << std::endl;
+
+    // 过载时宁可丢DEBUG日志也不阻塞，WARN及以上仍然等待
+    tensir::Logger::ptr overload(new tensir::Logger);
+    tensir::AsyncLogAppender::ptr bounded(new tensir::AsyncLogAppender(
+        tensir::LogAppender::ptr(new tensir::FileLogAppender("./overflow_test.log")), 1000, 4096, 2));
+    bounded->setOverflowPolicy(tensir::LogOverflowPolicy(tensir::LogOverflowPolicy::DROP_BELOW_LEVEL, 0, tensir::LogLevel::WARN));
+    overload->addAppender(bounded);
+    for (int i = 0; i < 100000; ++i)
+    {
+        tensir::LogLevel::Level level = i % 100 ? tensir::LogLevel::DEBUG : tensir::LogLevel::WARN;
+        TENSIR_LOG_LEVEL(overload, level) << "overflow message " << i;
+    }
+    bounded->stop();
+    std::cout << "dropped: " << bounded->getDroppedCount() << std::endl;
+    return 0;
+}
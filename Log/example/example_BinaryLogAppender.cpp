@@ -0,0 +1,39 @@
+#include "../LogBinary.h"
+#include <iostream>
+#include <unistd.h>
+
+using namespace tensir;
+
+int main()
+{
+    unlink("./binary_test.log");
+
+    // 流式日志写入文本，延迟格式化的日志只写入格式串id和编码后的参数
+    {
+        tensir::Logger::ptr logger(new tensir::Logger("binary"));
+        logger->addAppender(tensir::LogAppender::ptr(new tensir::BinaryLogAppender("./binary_test.log")));
+        for (int i = 0; i < 3; ++i)
+        {
+            TENSIR_LOG_LEVEL(logger, tensir::LogLevel::INFO) << "stream message " << i;
+            TENSIR_LOG_DEFER_LEVEL(logger, tensir::LogLevel::WARN, "deferred %s=%d cost=%.2f", "id", i, i * 1.5);
+        }
+    }
+
+    // 和log_decoder一样读回事件，按文本格式输出
+    tensir::BinaryLogReader reader("./binary_test.log");
+    if (!reader.isOpen())
+    {
+        std::cerr << "open binary_test.log failed" << std::endl;
+        return 1;
+    }
+    tensir::LogFormatter::ptr formatter(new tensir::LogFormatter("%d{%H:%M:%S.%6N}%T%t%T[%p]%T[%c]%T%f:%l%T%m%n"));
+    tensir::LogLevel::Level level;
+    int count = 0;
+    while (tensir::LogEvent::ptr event = reader.next(level))
+    {
+        formatter->format(std::cout, event->getLogger(), level, event);
+        ++count;
+    }
+    std::cout << "decoded " << count << " events" << std::endl;
+    return count == 6 ? 0 : 1;
+}
@@ -0,0 +1,30 @@
+#include "../Log.h"
+#include <iostream>
+#include <unistd.h>
+
+using namespace tensir;
+
+int main()
+{
+    // 标准输出是管道且读端停顿时丢弃日志而不是阻塞，例如 ./example_ConsoleLogAppender | (sleep 3; cat)
+    tensir::ConsoleLogAppender::ptr appender(new tensir::ConsoleLogAppender(STDOUT_FILENO, true, 64 * 1024));
+    tensir::Logger::ptr logger(new tensir::Logger);
+    logger->addAppender(appender);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([logger, t]() {
+            for (int i = 0; i < 10000; ++i)
+            {
+                TENSIR_LOG_LEVEL(logger, tensir::LogLevel::INFO) << "console message " << t << " " << i;
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    std::cerr << "nonblock: " << appender->isNonblock() << " dropped: " << appender->getDroppedCount() << std::endl;
+    return 0;
+}
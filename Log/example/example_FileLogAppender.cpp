@@ -0,0 +1,48 @@
+#include "../Log.h"
+#include <iostream>
+#include <unistd.h>
+
+using namespace tensir;
+
+int main()
+{
+    tensir::Logger::ptr logger(new tensir::Logger);
+
+    // 每个文件64KB，只保留最近3个：rolling_test.log.N
+    tensir::FileLogAppender::ptr appender(new tensir::FileLogAppender("./rolling_test.log", 64 * 1024, 0, 3));
+    logger->addAppender(appender);
+
+    for (int i = 0; i < 5000; ++i)
+    {
+        TENSIR_LOG_LEVEL(logger, tensir::LogLevel::INFO) << "rolling message " << i;
+        if (i % 1000 == 0)
+        {
+            // 给后台线程时间预先打开下一个文件并清理旧文件
+            usleep(1000 * 100);
+        }
+    }
+    appender->flush();
+    std::cout << "current file: " << appender->getCurrentFile() << std::endl;
+
+    // 组提交：ERROR日志返回时已经落盘，多个线程同时等待时共用一次fdatasync
+    tensir::Logger::ptr audit(new tensir::Logger);
+    tensir::FileLogAppender::ptr audit_appender(new tensir::FileLogAppender("./audit_test.log"));
+    audit_appender->setDurability(tensir::FileLogAppender::GROUP_COMMIT);
+    audit->addAppender(audit_appender);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([audit, t]() {
+            for (int i = 0; i < 100; ++i)
+            {
+                TENSIR_LOG_LEVEL(audit, tensir::LogLevel::INFO) << "audit detail " << t << " " << i;
+                TENSIR_LOG_LEVEL(audit, tensir::LogLevel::ERROR) << "audit record " << t << " " << i;
+            }
+        });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    return 0;
+}
@@ -0,0 +1,40 @@
+#include "../Log.h"
+#include <iostream>
+
+using namespace tensir;
+
+int main()
+{
+    tensir::Logger::ptr logger(new tensir::Logger);
+    logger->addAppender(tensir::LogAppender::ptr(new tensir::StdoutLogAppender));
+    logger->setDispatcher(tensir::LogDispatcher::ptr(new tensir::LogDispatcher(1024)));
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.push_back(std::thread([logger, t]() {
+            for (int i = 0; i < 5; ++i)
+            {
+                tensir::LogEvent::ptr event(new tensir::LogEvent(logger,
+                                                                 tensir::LogLevel::INFO,
+                                                                 __FILE__,
+                                                                 __LINE__,
+                                                                 0,
+                                                                 t,
+                                                                 1,
+                                                                 tensir::GetCurrentNS(),
+                                                                 "worker"));
+                event->getSS() << "thread " << t << " message " << i;
+                logger->log(tensir::LogLevel::INFO, event);
+            }
+        }));
+    }
+    for (auto &i : threads)
+    {
+        i.join();
+    }
+
+    logger->getDispatcher()->flush();
+    std::cout << "rings: " << logger->getDispatcher()->getRingCount() << std::endl;
+    return 0;
+}
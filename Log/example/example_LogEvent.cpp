@@ -15,6 +15,10 @@ int main()
 
     std::cout<<log.getContent()<<std::endl;
 
+    LogEvent deferred;
+    deferred.defer("延迟格式化：%d %c %s %p\n", a, ch, str, &a);
+    std::cout<<deferred.getContent()<<std::endl;
+
     return 0;
 
 }
\ No newline at end of file
@@ -0,0 +1,27 @@
+#include "../LogStream.h"
+#include <iomanip>
+#include <iostream>
+
+using namespace tensir;
+
+int main()
+{
+    LogStream stream;
+
+    int a = 10;
+    std::string str = "hello world!";
+    stream << "测试一下：" << a << ' ' << -3.25 << ' ' << str << ' ' << &a;
+
+    std::cout << std::string(stream.data(), stream.size()) << std::endl;
+    std::cout << "size: " << stream.size() << " capacity: " << stream.capacity() << std::endl;
+
+    stream.clear();
+    stream.appendf("%s %d", str.c_str(), a);
+    std::cout << stream.str() << std::endl;
+
+    // 操纵符设置的格式状态保存在流中，输出与std::stringstream一致
+    stream.clear();
+    stream << std::hex << 255 << ' ' << std::setprecision(2) << 3.14159 << ' ' << std::fixed << 2.5;
+    std::cout << stream.str() << std::endl;
+    return 0;
+}
@@ -15,7 +15,7 @@ int main()
                                                      123,
                                                      0,
                                                      1,
-                                                     time(0),
+                                                     tensir::GetCurrentNS(),
                                                      "main"));
     event->getSS() << "hello tensir log";
     logger->log(tensir::LogLevel::DEBUG, event);
@@ -25,4 +25,46 @@ int main()
 
     LoggerManager LoggerMgr;
     TENSIR_LOG_DEBUG(LoggerMgr.getRoot()) << "hello";
+
+    // net.http.client没有日志目标和级别，沿用root的Appender和net的级别
+    Logger::ptr client = LoggerMgr.getLogger("net.http.client");
+    LoggerMgr.getLogger("net")->setLevel(LogLevel::WARN);
+    TENSIR_LOG_LEVEL(client, LogLevel::INFO) << "filtered by net";
+    TENSIR_LOG_LEVEL(client, LogLevel::WARN) << "hello from " << client->getName();
+
+    // 循环中的错误日志按调用点限流，被拒绝的调用不会生成日志事件
+    for (int i = 0; i < 1000; ++i)
+    {
+        TENSIR_LOG_FIRST_N(client, LogLevel::ERROR, 3) << "first 3 of 1000, i=" << i;
+        TENSIR_LOG_EVERY_N(client, LogLevel::ERROR, 250) << "every 250th, i=" << i;
+        TENSIR_LOG_EVERY_MS(client, LogLevel::ERROR, 1000) << "at most once per second, i=" << i;
+        TENSIR_LOG_FMT_SAMPLED(client, LogLevel::ERROR, 0.005, "sampled 0.5%%, i=%d", i);
+    }
+
+    // 连续重复的日志只输出第一条和一条汇总
+    Logger::ptr retry(new Logger("retry"));
+    DedupLogAppender::ptr dedup(new DedupLogAppender(LogAppender::ptr(new StdoutLogAppender)));
+    retry->addAppender(dedup);
+    for (int i = 0; i < 100000; ++i)
+    {
+        TENSIR_LOG_LEVEL(retry, LogLevel::ERROR) << "connect to 10.0.0.1:80 failed";
+    }
+    TENSIR_LOG_LEVEL(retry, LogLevel::INFO) << "connected, suppressed " << dedup->getSuppressedCount();
+
+    // 结构化字段按类型保存，json格式化器一次写出整行JSON
+    Logger::ptr access(new Logger("access"));
+    LogAppender::ptr json(new StdoutLogAppender);
+    json->setFormatter(LogFormatter::ptr(new LogFormatter("json")));
+    access->addAppender(json);
+    TENSIR_LOG_EVENT(access, LogLevel::INFO).with("method", "GET").with("path", "/index.html").with("status", 200).with("cost_ms", 1.5).getSS()
+        << "request done";
+
+    // 时间戳改为读取TSC，格式化时才换算为墙上时间
+    if (LogClock::SetSource(LogClock::TSC))
+    {
+        TENSIR_LOG_DEBUG(logger) << "stamped with tsc";
+    }
+
+    // 自身指标：每个日志器和日志目标的计数与采样耗时
+    std::cout << LoggerMgr.getMetricsJson() << std::endl;
 }
\ No newline at end of file
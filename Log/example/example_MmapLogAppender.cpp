@@ -0,0 +1,36 @@
+#include "../LogMmap.h"
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+using namespace tensir;
+
+int main()
+{
+    unlink("./mmap_test.log");
+
+    // 子进程写完日志后直接abort，没有flush也没有析构
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        tensir::Logger::ptr logger(new tensir::Logger);
+        logger->addAppender(tensir::LogAppender::ptr(new tensir::MmapLogAppender("./mmap_test.log", 1024 * 1024)));
+        for (int i = 0; i < 10000; ++i)
+        {
+            TENSIR_LOG_LEVEL(logger, tensir::LogLevel::INFO) << "mmap message " << i;
+        }
+        abort();
+    }
+    waitpid(pid, nullptr, 0);
+
+    // 重新打开时找回写入位置，接着追加
+    tensir::MmapLogAppender::ptr appender(new tensir::MmapLogAppender("./mmap_test.log", 1024 * 1024));
+    std::cout << "recovered tail: " << appender->getTail() << std::endl;
+
+    tensir::Logger::ptr logger(new tensir::Logger);
+    logger->addAppender(appender);
+    TENSIR_LOG_LEVEL(logger, tensir::LogLevel::INFO) << "after crash";
+    std::cout << "tail: " << appender->getTail() << std::endl;
+    return 0;
+}
@@ -0,0 +1,33 @@
+#include "../LogUring.h"
+#include <iostream>
+#include <unistd.h>
+
+using namespace tensir;
+
+int main()
+{
+    unlink("./uring_test.log");
+    unlink("./uring_pwritev_test.log");
+
+    // 作为AsyncLogAppender的目标，后台线程只拷贝数据和提交写请求
+    tensir::UringLogAppender::ptr uring(new tensir::UringLogAppender("./uring_test.log", 64 * 1024, 4));
+    std::cout << "io_uring enabled: " << uring->isUringEnabled() << std::endl;
+    tensir::Logger::ptr logger(new tensir::Logger);
+    logger->addAppender(tensir::LogAppender::ptr(new tensir::AsyncLogAppender(uring, 1000)));
+    for (int i = 0; i < 100000; ++i)
+    {
+        TENSIR_LOG_LEVEL(logger, tensir::LogLevel::INFO) << "uring message " << i;
+    }
+
+    // 不使用io_uring时攒满多块缓冲后一次pwritev
+    tensir::UringLogAppender::ptr fallback(new tensir::UringLogAppender("./uring_pwritev_test.log", 64 * 1024, 4, false));
+    tensir::Logger::ptr logger2(new tensir::Logger);
+    logger2->addAppender(fallback);
+    for (int i = 0; i < 100000; ++i)
+    {
+        TENSIR_LOG_LEVEL(logger2, tensir::LogLevel::INFO) << "pwritev message " << i;
+    }
+    fallback->sync();
+    std::cout << "dropped bytes: " << uring->getDroppedBytes() << " " << fallback->getDroppedBytes() << std::endl;
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include "../LogBinary.h"
+#include <iostream>
+
+using namespace tensir;
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " <binary log file> [pattern]" << std::endl;
+        return 1;
+    }
+
+    std::string pattern = argc > 2 ? argv[2] : "%d{%Y-%m-%d %H:%M:%S.%6N}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+    LogFormatter::ptr formatter(new LogFormatter(pattern));
+    if (formatter->isError())
+    {
+        std::cerr << "invalid pattern: " << pattern << std::endl;
+        return 1;
+    }
+
+    BinaryLogReader reader(argv[1]);
+    if (!reader.isOpen())
+    {
+        std::cerr << "not a binary log file: " << argv[1] << std::endl;
+        return 1;
+    }
+
+    LogLevel::Level level;
+    while (LogEvent::ptr event = reader.next(level))
+    {
+        formatter->format(std::cout, event->getLogger(), level, event);
+    }
+    return reader.isOpen() ? 0 : 2;
+}